@@ -0,0 +1,285 @@
+// Benchmarks for the non-model hot paths of cppVer.
+//
+// All inputs are generated at runtime and no models are loaded, so the suite
+// runs offline. Results are written as JSON so runs from different builds can
+// be diffed:
+//   cppVer_bench [output.json]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "audio_utils.hpp"
+#include "imwrite.hpp"
+#include "llm_output.hpp"
+#include "result_cache.hpp"
+
+using json = nlohmann::json;
+
+constexpr double pi = 3.14159265358979323846;
+
+// ----------------- Harness -----------------
+std::vector<json> results;
+
+/**
+ * @brief Runs `f` once to warm up and then `iterations` times, recording the
+ * wall time of every run.
+ *
+ * @param name Benchmark name, used as the key when diffing runs.
+ * @param iterations Number of timed runs.
+ * @param bytes Input size processed per run, 0 if throughput is meaningless.
+ * @param f Function to benchmark.
+ */
+template <typename F>
+void runBenchmark(const std::string &name, size_t iterations, size_t bytes,
+                  F &&f) {
+  // library code logs to stdout, only the benchmark summary is wanted
+  std::streambuf *coutBuf = std::cout.rdbuf(nullptr);
+  f();
+  std::vector<double> times;
+  for (size_t i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    times.push_back(
+        std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  std::cout.clear();
+  std::cout.rdbuf(coutBuf);
+
+  double mean = 0.0;
+  for (double t : times) {
+    mean += t;
+  }
+  mean /= times.size();
+  double min = *std::ranges::min_element(times);
+  double max = *std::ranges::max_element(times);
+
+  json result = {{"name", name},         {"iterations", iterations},
+                 {"min_ms", min},        {"mean_ms", mean},
+                 {"max_ms", max}};
+  if (bytes > 0) {
+    result["bytes"] = bytes;
+    result["mb_per_s"] = bytes / (min / 1000.0) / (1024.0 * 1024.0);
+  }
+  std::cerr << name << ": min " << min << " ms, mean " << mean << " ms"
+            << std::endl;
+  results.push_back(result);
+}
+
+// ----------------- Synthetic Inputs -----------------
+
+// 16 bit PCM sine sweep, loud enough to exercise the full sample range
+std::string makeWav(uint32_t sampleRate, uint16_t channels, double seconds) {
+  const uint32_t frames = uint32_t(sampleRate * seconds);
+  const uint32_t dataSize = frames * channels * 2;
+  std::string wav(44 + dataSize, '\0');
+  auto put16 = [&](size_t pos, uint16_t v) {
+    wav[pos] = char(v & 0xFF);
+    wav[pos + 1] = char(v >> 8);
+  };
+  auto put32 = [&](size_t pos, uint32_t v) {
+    put16(pos, uint16_t(v & 0xFFFF));
+    put16(pos + 2, uint16_t(v >> 16));
+  };
+  wav.replace(0, 4, "RIFF");
+  put32(4, 36 + dataSize);
+  wav.replace(8, 8, "WAVEfmt ");
+  put32(16, 16);
+  put16(20, 1);  // PCM
+  put16(22, channels);
+  put32(24, sampleRate);
+  put32(28, sampleRate * channels * 2);
+  put16(32, uint16_t(channels * 2));
+  put16(34, 16);
+  wav.replace(36, 4, "data");
+  put32(40, dataSize);
+
+  for (uint32_t i = 0; i < frames; i++) {
+    double t = double(i) / sampleRate;
+    double sample = std::sin(2.0 * pi * (220.0 + 200.0 * t) * t);
+    for (uint16_t c = 0; c < channels; c++) {
+      put16(44 + (size_t(i) * channels + c) * 2,
+            uint16_t(int16_t(sample * (c == 0 ? 30000 : -20000))));
+    }
+  }
+  return wav;
+}
+
+std::filesystem::path writeFile(const std::filesystem::path &path,
+                                const std::string &data) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(data.data(), data.size());
+  return path;
+}
+
+// LLM output shaped like the extraction prompts ask for, repeated to `size`
+std::string makeLlmOutput(size_t size) {
+  const std::string block =
+      "Color 1: #1A2B3C\nColor 2: #A0B1C2\nObject 1: $Glass Lantern$\n"
+      "Background 1: $Frozen Fjord$\nColor 1 reason: the shimmer of ice on a "
+      "dark night sky, echoed by the cold wind in the second verse.\n";
+  std::string output;
+  output.reserve(size + block.size());
+  while (output.size() < size) {
+    output += block;
+  }
+  return output;
+}
+
+// ----------------- Benchmarks -----------------
+
+void benchReadWav(const std::filesystem::path &dir) {
+  for (uint16_t channels : {1, 2}) {
+    std::string label = channels == 1 ? "mono" : "stereo";
+    std::string wav =
+        makeWav(utils::audio::COMMON_SAMPLE_RATE, channels, 60.0);
+    std::string path = writeFile(dir / (label + ".wav"), wav).string();
+
+    runBenchmark("read_wav/file/" + label, 10, wav.size(),
+                 [&] { utils::audio::read_wav(path); });
+    runBenchmark("read_wav/stdin/" + label, 10, wav.size(), [&] {
+      if (!std::freopen(path.c_str(), "rb", stdin)) {
+        throw std::runtime_error("Unable to reopen stdin");
+      }
+      utils::audio::read_wav("-");
+    });
+    runBenchmark("read_wav/memory/" + label, 10, wav.size(),
+                 [&] { utils::audio::read_wav(wav); });
+  }
+}
+
+void benchResample(const std::filesystem::path &dir) {
+  const std::vector<std::pair<std::string, utils::audio::ResampleQuality>>
+      qualities = {{"best", utils::audio::ResampleQuality::Best},
+                   {"medium", utils::audio::ResampleQuality::Medium},
+                   {"fastest", utils::audio::ResampleQuality::Fastest},
+                   {"linear", utils::audio::ResampleQuality::Linear}};
+
+  const uint32_t inputRate = 44100;
+  std::vector<float> samples(inputRate * 10);
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = float(std::sin(2.0 * pi * 440.0 * i / inputRate));
+  }
+  std::string wav = makeWav(inputRate, 2, 30.0);
+  std::string path = writeFile(dir / "stereo_44k.wav", wav).string();
+
+  for (const auto &[name, quality] : qualities) {
+    runBenchmark("resampleWav/" + name, 3, samples.size() * sizeof(float),
+                 [&] {
+                   utils::audio::resampleWav(
+                       samples, inputRate, utils::audio::COMMON_SAMPLE_RATE, 1,
+                       quality);
+                 });
+    runBenchmark("read_wav/resample/" + name, 3, wav.size(),
+                 [&] { utils::audio::read_wav(path, quality); });
+  }
+}
+
+void benchImwrite(const std::filesystem::path &dir) {
+  const size_t height = 512, width = 512;
+  for (size_t batch : {1, 2, 4, 8}) {
+    ov::Tensor images(ov::element::u8, ov::Shape{batch, height, width, 3});
+    uint8_t *data = images.data<uint8_t>();
+    for (size_t i = 0; i < images.get_byte_size(); i++) {
+      data[i] = uint8_t(i * 31 + i / 7);
+    }
+    std::string suffix = std::to_string(batch);
+    runBenchmark("imwrite/bmp/" + suffix, 10, images.get_byte_size(), [&] {
+      imwrite((dir / "image_%d.bmp").string(), images, true);
+    });
+    runBenchmark("imwrite/png/" + suffix, 10, images.get_byte_size(), [&] {
+      imwrite((dir / "image_%d.png").string(), images, true, ImageFormat::PNG);
+    });
+  }
+}
+
+void benchLlmOutput(const std::filesystem::path &dir) {
+  for (size_t size : {size_t(4) << 10, size_t(256) << 10}) {
+    std::string output = makeLlmOutput(size);
+    std::string suffix = std::to_string(size >> 10) + "KB";
+    runBenchmark("getOptionsFromLlmOutput/" + suffix, 10, output.size(),
+                 [&] { getOptionsFromLlmOutput(output); });
+    runBenchmark("getHexColoursFromLlmOutput/" + suffix, 10, output.size(),
+                 [&] { getHexColoursFromLlmOutput(output); });
+  }
+
+  LLMOutputMap outputMap;
+  std::string text = makeLlmOutput(2 << 10);
+  for (const auto &[type, isVector] : outputTypeIsVector) {
+    outputMap[type] = isVector ? std::vector<std::string>(5, text)
+                               : std::vector<std::string>{text};
+  }
+  std::string path = (dir / "songData.json").string();
+  runBenchmark("jsonStoreData+retrieveCurrentOutput", 20, 0, [&] {
+    writeOutputFile(path, outputMap, false);
+    readOutputFile(path);
+  });
+}
+
+void benchResultCache(const std::filesystem::path &dir) {
+  std::string lyrics = makeLlmOutput(4 << 10);
+  std::string output = makeLlmOutput(2 << 10);
+  runBenchmark("ResultCache::makeKey", 100, lyrics.size() * 2, [&] {
+    ResultCache::makeKey({"model", "GPU", "extractColour", lyrics, lyrics});
+  });
+
+  // small limit, so every put also evicts
+  ResultCache cache(dir / "cache", 64 << 10);
+  size_t next = 0;
+  runBenchmark("ResultCache::put+get", 20, output.size(), [&] {
+    std::string key = ResultCache::makeKey({std::to_string(next++)});
+    cache.put(key, output);
+    cache.get(key);
+  });
+}
+
+// ----------------- Main Function -----------------
+int main(int argc, char *argv[]) {
+  std::string outputPath = argc > 1 ? argv[1] : "cppVer_bench.json";
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "cppVer_bench";
+  std::filesystem::create_directories(dir);
+
+  try {
+    benchReadWav(dir);
+    benchResample(dir);
+    benchImwrite(dir);
+    benchLlmOutput(dir);
+    benchResultCache(dir);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    std::filesystem::remove_all(dir);
+    return 1;
+  }
+  std::filesystem::remove_all(dir);
+
+  json report = {
+#if defined(__clang__)
+      {"compiler", "clang " __clang_version__},
+#elif defined(__GNUC__)
+      {"compiler", "gcc " __VERSION__},
+#elif defined(_MSC_VER)
+      {"compiler", "msvc " + std::to_string(_MSC_VER)},
+#endif
+#ifdef NDEBUG
+      {"build", "release"},
+#else
+      {"build", "debug"},
+#endif
+      {"results", results}};
+  std::ofstream outputFile(outputPath);
+  outputFile << std::setw(4) << report << std::endl;
+  std::cerr << "Results written to " << outputPath << std::endl;
+  return 0;
+}
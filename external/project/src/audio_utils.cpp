@@ -3,7 +3,11 @@
 
 #include "audio_utils.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 
 #include "openvino/genai/whisper_pipeline.hpp"
@@ -12,6 +16,11 @@
 #include <dr_wav.h>
 #include <samplerate.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_UTILS_SSE2
+#include <emmintrin.h>
+#endif
+
 #ifdef _WIN32
 #include <fcntl.h>
 #include <io.h>
@@ -36,6 +45,93 @@ namespace
 
     return true;
   }
+  // PCM frames decoded per dr_wav call when streaming
+  constexpr size_t BLOCK_FRAMES = 4096;
+
+  // Converts interleaved s16 mono or stereo frames to mono float in [-1, 1)
+  void s16ToMonoF32(const int16_t *in, float *out, size_t frames, uint32_t channels)
+  {
+    size_t i = 0;
+    if (channels == 1)
+    {
+#ifdef AUDIO_UTILS_SSE2
+      const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+      for (; i + 8 <= frames; i += 8)
+      {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // sign extend the 16 bit samples to 32 bit
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+      }
+#endif
+      for (; i < frames; i++)
+      {
+        out[i] = float(in[i]) / 32768.0f;
+      }
+    }
+    else
+    {
+#ifdef AUDIO_UTILS_SSE2
+      const __m128 scale = _mm_set1_ps(1.0f / 65536.0f);
+      const __m128i ones = _mm_set1_epi16(1);
+      for (; i + 4 <= frames; i += 4)
+      {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i));
+        // multiply-add with ones sums each left/right pair into 32 bit
+        __m128i sum = _mm_madd_epi16(x, ones);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(sum), scale));
+      }
+#endif
+      for (; i < frames; i++)
+      {
+        out[i] = float(in[2 * i] + in[2 * i + 1]) / 65536.0f;
+      }
+    }
+  }
+
+  // dr_wav callbacks for stdin, which can only be read forwards
+  size_t onReadStdin(void *, void *buffer, size_t bytes)
+  {
+    return fread(buffer, 1, bytes, stdin);
+  }
+
+  drwav_bool32 onSeekStdin(void *, int offset, drwav_seek_origin origin)
+  {
+    if (origin != drwav_seek_origin_current || offset < 0)
+    {
+      return DRWAV_FALSE;
+    }
+    uint8_t buf[1024];
+    while (offset > 0)
+    {
+      const size_t n = fread(buf, 1, std::min(sizeof(buf), size_t(offset)), stdin);
+      if (n == 0)
+      {
+        return DRWAV_FALSE;
+      }
+      offset -= int(n);
+    }
+    return DRWAV_TRUE;
+  }
+
+  int toConverterType(utils::audio::ResampleQuality quality)
+  {
+    switch (quality)
+    {
+    case utils::audio::ResampleQuality::Best:
+      return SRC_SINC_BEST_QUALITY;
+    case utils::audio::ResampleQuality::Medium:
+      return SRC_SINC_MEDIUM_QUALITY;
+    case utils::audio::ResampleQuality::Linear:
+      return SRC_LINEAR;
+    case utils::audio::ResampleQuality::Fastest:
+    default:
+      return SRC_SINC_FASTEST;
+    }
+  }
+
   struct WavData
   {
     std::vector<float> samples;
@@ -61,33 +157,6 @@ namespace
     return {samples, wav.sampleRate, wav.channels};
   }
 
-  // Resample WAV data using libsamplerate
-  std::vector<float> resampleWav(const std::vector<float> &inputSamples,
-                                 uint32_t inputRate, uint32_t outputRate,
-                                 uint32_t channels)
-  {
-    double ratio = static_cast<double>(outputRate) / inputRate;
-    size_t outputFrames = static_cast<size_t>(inputSamples.size() / channels * ratio);
-    std::vector<float> outputSamples(outputFrames * channels);
-
-    SRC_DATA srcData;
-    srcData.data_in = inputSamples.data();
-    srcData.input_frames = inputSamples.size() / channels;
-    srcData.data_out = outputSamples.data();
-    srcData.output_frames = outputFrames;
-    srcData.src_ratio = ratio;
-    srcData.end_of_input = 1;
-
-    int error = src_simple(&srcData, SRC_SINC_BEST_QUALITY, channels);
-    if (error)
-    {
-      std::cerr << "libsamplerate error: " << src_strerror(error) << std::endl;
-      exit(1);
-    }
-
-    return outputSamples;
-  }
-
   // Write WAV file using dr_wav
   void writeWav(const char *filename, const std::vector<float> &samples,
                 uint32_t sampleRate, uint32_t channels)
@@ -117,59 +186,126 @@ namespace utils
   namespace audio
   {
 
-#define COMMON_SAMPLE_RATE 16000
+    ResampleQuality parseResampleQuality(const std::string &name)
+    {
+      if (name == "best")
+        return ResampleQuality::Best;
+      if (name == "medium")
+        return ResampleQuality::Medium;
+      if (name == "fastest")
+        return ResampleQuality::Fastest;
+      if (name == "linear")
+        return ResampleQuality::Linear;
+      throw std::invalid_argument("Unknown resample quality: " + name);
+    }
 
-    void fixSampleRate(const std::string &inputFile, const std::string &outputFile)
+    struct WavReader::Impl
     {
-      WavData wavData = readWav(inputFile.c_str());
-      if (wavData.sampleRate != COMMON_SAMPLE_RATE)
+      drwav wav;
+      std::vector<uint8_t> wav_data; // in-memory WAV buffer or ffmpeg decoding output
+      std::vector<int16_t> pcm16;
+
+      // only set when the file is not already 16 kHz
+      SRC_STATE *src = nullptr;
+      double ratio = 1.0;
+      std::vector<float> mono; // decoded block waiting to be resampled
+      size_t monoPos = 0;
+      size_t monoLen = 0;
+      bool inputEnded = false;
+
+      std::chrono::steady_clock::duration decodeTime{};
+      std::chrono::steady_clock::duration resampleTime{};
+
+      size_t decode(float *out, size_t frames);
+      size_t resample(float *out, size_t frames);
+    };
+
+    // reads up to `frames` mono frames at the file's own sample rate
+    size_t WavReader::Impl::decode(float *out, size_t frames)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      size_t total = 0;
+      while (total < frames)
       {
-        std::vector<float> resampledSamples = resampleWav(wavData.samples, wavData.sampleRate, COMMON_SAMPLE_RATE, wavData.channels);
-        writeWav(outputFile.c_str(), resampledSamples, COMMON_SAMPLE_RATE, wavData.channels);
+        const size_t want = std::min(BLOCK_FRAMES, frames - total);
+        const size_t got = drwav_read_pcm_frames_s16(&wav, want, pcm16.data());
+        s16ToMonoF32(pcm16.data(), out + total, got, wav.channels);
+        total += got;
+        if (got < want)
+        {
+          break;
+        }
       }
-      else
+      decodeTime += std::chrono::steady_clock::now() - start;
+      return total;
+    }
+
+    // streams decoded blocks through libsamplerate until `frames` 16 kHz frames are produced
+    size_t WavReader::Impl::resample(float *out, size_t frames)
+    {
+      size_t total = 0;
+      while (total < frames)
       {
-        writeWav(outputFile.c_str(), wavData.samples, COMMON_SAMPLE_RATE, wavData.channels);
+        if (monoPos == monoLen && !inputEnded)
+        {
+          monoLen = decode(mono.data(), BLOCK_FRAMES);
+          monoPos = 0;
+          inputEnded = monoLen < BLOCK_FRAMES;
+        }
+
+        SRC_DATA srcData;
+        srcData.data_in = mono.data() + monoPos;
+        srcData.input_frames = long(monoLen - monoPos);
+        srcData.data_out = out + total;
+        srcData.output_frames = long(frames - total);
+        srcData.src_ratio = ratio;
+        srcData.end_of_input = inputEnded;
+
+        const auto start = std::chrono::steady_clock::now();
+        int error = src_process(src, &srcData);
+        resampleTime += std::chrono::steady_clock::now() - start;
+        if (error)
+        {
+          throw std::runtime_error(std::string("libsamplerate error: ") + src_strerror(error));
+        }
+        monoPos += srcData.input_frames_used;
+        total += srcData.output_frames_gen;
+
+        // the converter has been flushed
+        if (inputEnded && monoPos == monoLen && srcData.output_frames_gen == 0)
+        {
+          break;
+        }
       }
+      return total;
     }
 
-    ov::genai::RawSpeechInput read_wav(const std::string &filename)
+    WavReader::WavReader(const std::string &filename, ResampleQuality quality) : impl(std::make_unique<Impl>())
     {
-      drwav wav;
-      std::vector<uint8_t> wav_data; // used for pipe input from stdin or ffmpeg decoding output
+      drwav &wav = impl->wav;
 
       if (filename == "-")
       {
-        {
 #ifdef _WIN32
-          _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdin), _O_BINARY);
 #endif
-
-          uint8_t buf[1024];
-          while (true)
-          {
-            const size_t n = fread(buf, 1, sizeof(buf), stdin);
-            if (n == 0)
-            {
-              break;
-            }
-            wav_data.insert(wav_data.end(), buf, buf + n);
-          }
-        }
-
-        OPENVINO_ASSERT(drwav_init_memory(&wav, wav_data.data(), wav_data.size(), nullptr),
+        // sequential mode only ever seeks forwards, which stdin supports
+        OPENVINO_ASSERT(drwav_init_ex(&wav, onReadStdin, onSeekStdin, nullptr, nullptr, nullptr,
+                                      DRWAV_SEQUENTIAL, nullptr),
                         "Failed to open WAV file from stdin");
-
-        fprintf(stderr, "%s: read %zu bytes from stdin\n", __func__, wav_data.size());
       }
       else if (is_wav_buffer(filename))
       {
-        OPENVINO_ASSERT(drwav_init_memory(&wav, filename.c_str(), filename.size(), nullptr),
+        // dr_wav reads from the buffer on every read(), so keep a copy that lives as long as the reader
+        std::vector<uint8_t> &wav_data = impl->wav_data;
+        wav_data.assign(filename.begin(), filename.end());
+        OPENVINO_ASSERT(drwav_init_memory(&wav, wav_data.data(), wav_data.size(), nullptr),
                         "Failed to open WAV file from fname buffer");
       }
       else if (!drwav_init_file(&wav, filename.c_str(), nullptr))
       {
 #if defined(WHISPER_FFMPEG)
+        std::vector<uint8_t> &wav_data = impl->wav_data;
         OPENVINO_ASSERT(ffmpeg_decode_audio(fname, wav_data) == 0, "Failed to ffmpeg decode")
 
         OPENVINO_ASSERT(drwav_init_memory(&wav, wav_data.data(), wav_data.size(), nullptr),
@@ -186,37 +322,105 @@ namespace utils
       }
 
       std::cout << "Sample rate: " << wav.sampleRate << std::endl;
+      impl->pcm16.resize(BLOCK_FRAMES * wav.channels);
+
       if (wav.sampleRate != COMMON_SAMPLE_RATE)
       {
-        drwav_uninit(&wav);
-        throw std::runtime_error("WAV file must be " + std::string{COMMON_SAMPLE_RATE / 1000} + " kHz. Run fixSampleRate flag instead.");
+        // channels are already mixed down, so only one goes through the filter
+        int error = 0;
+        impl->src = src_new(toConverterType(quality), 1, &error);
+        if (!impl->src)
+        {
+          drwav_uninit(&wav);
+          throw std::runtime_error(std::string("libsamplerate error: ") + src_strerror(error));
+        }
+        impl->ratio = static_cast<double>(COMMON_SAMPLE_RATE) / wav.sampleRate;
+        impl->mono.resize(BLOCK_FRAMES);
+        std::cout << "Resampling to " << COMMON_SAMPLE_RATE << " Hz" << std::endl;
       }
+    }
 
-      const uint64_t n =
-          wav_data.empty() ? wav.totalPCMFrameCount : wav_data.size() / (wav.channels * wav.bitsPerSample / 8);
+    WavReader::~WavReader()
+    {
+      if (impl->src)
+      {
+        src_delete(impl->src);
+      }
+      drwav_uninit(&impl->wav);
+    }
 
-      std::vector<int16_t> pcm16;
-      pcm16.resize(n * wav.channels);
-      drwav_read_pcm_frames_s16(&wav, n, pcm16.data());
-      drwav_uninit(&wav);
+    size_t WavReader::read(float *out, size_t frames)
+    {
+      return impl->src ? impl->resample(out, frames) : impl->decode(out, frames);
+    }
 
-      // convert to mono, float
-      std::vector<float> pcmf32;
-      pcmf32.resize(n);
-      if (wav.channels == 1)
+    double WavReader::decodeMs() const
+    {
+      return std::chrono::duration<double, std::milli>(impl->decodeTime).count();
+    }
+
+    double WavReader::resampleMs() const
+    {
+      return std::chrono::duration<double, std::milli>(impl->resampleTime).count();
+    }
+
+    uint32_t WavReader::sourceSampleRate() const
+    {
+      return impl->wav.sampleRate;
+    }
+
+    // Resample WAV data using libsamplerate
+    std::vector<float> resampleWav(const std::vector<float> &inputSamples,
+                                   uint32_t inputRate, uint32_t outputRate,
+                                   uint32_t channels, ResampleQuality quality)
+    {
+      double ratio = static_cast<double>(outputRate) / inputRate;
+      size_t outputFrames = static_cast<size_t>(inputSamples.size() / channels * ratio);
+      std::vector<float> outputSamples(outputFrames * channels);
+
+      SRC_DATA srcData;
+      srcData.data_in = inputSamples.data();
+      srcData.input_frames = inputSamples.size() / channels;
+      srcData.data_out = outputSamples.data();
+      srcData.output_frames = outputFrames;
+      srcData.src_ratio = ratio;
+      srcData.end_of_input = 1;
+
+      int error = src_simple(&srcData, toConverterType(quality), channels);
+      if (error)
       {
-        for (uint64_t i = 0; i < n; i++)
-        {
-          pcmf32[i] = float(pcm16[i]) / 32768.0f;
-        }
+        throw std::runtime_error(std::string("libsamplerate error: ") + src_strerror(error));
+      }
+
+      return outputSamples;
+    }
+
+    void fixSampleRate(const std::string &inputFile, const std::string &outputFile)
+    {
+      WavData wavData = readWav(inputFile.c_str());
+      if (wavData.sampleRate != COMMON_SAMPLE_RATE)
+      {
+        std::vector<float> resampledSamples = resampleWav(wavData.samples, wavData.sampleRate, COMMON_SAMPLE_RATE, wavData.channels, ResampleQuality::Best);
+        writeWav(outputFile.c_str(), resampledSamples, COMMON_SAMPLE_RATE, wavData.channels);
       }
       else
       {
-        for (uint64_t i = 0; i < n; i++)
-        {
-          pcmf32[i] = float(pcm16[2 * i] + pcm16[2 * i + 1]) / 65536.0f;
-        }
+        writeWav(outputFile.c_str(), wavData.samples, COMMON_SAMPLE_RATE, wavData.channels);
       }
+    }
+
+    ov::genai::RawSpeechInput read_wav(const std::string &filename, ResampleQuality quality)
+    {
+      WavReader reader(filename, quality);
+
+      std::vector<float> pcmf32;
+      size_t n = 0;
+      do
+      {
+        pcmf32.resize(n + BLOCK_FRAMES * 16);
+        n += reader.read(pcmf32.data() + n, pcmf32.size() - n);
+      } while (n == pcmf32.size());
+      pcmf32.resize(n);
 
       return pcmf32;
     }
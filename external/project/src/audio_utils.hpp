@@ -2,11 +2,76 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #include "openvino/genai/whisper_pipeline.hpp"
 
 namespace utils {
 namespace audio {
+// sample rate Whisper expects, every reader output is converted to it
+constexpr uint32_t COMMON_SAMPLE_RATE = 16000;
+
+/**
+ * @brief libsamplerate converter used when the input is not 16 kHz, from slowest to fastest
+ */
+enum class ResampleQuality { Best, Medium, Fastest, Linear };
+
+/**
+ * @brief Parses "best", "medium", "fastest" or "linear"
+ * @throws std::invalid_argument for any other name
+ */
+ResampleQuality parseResampleQuality(const std::string& name);
+
+/**
+ * @brief Reads a mono or stereo WAV file in fixed size blocks as mono 16 kHz float samples.
+ *
+ * Only one block of PCM data is held at a time, so memory use does not depend on the
+ * length of the file. `filename` may be a path, "-" for stdin or an in-memory WAV buffer,
+ * which is copied so it does not have to outlive the reader.
+ * Other sample rates are mixed down to mono and then resampled on the fly.
+ */
+class WavReader {
+public:
+    explicit WavReader(const std::string& filename, ResampleQuality quality = ResampleQuality::Fastest);
+    ~WavReader();
+
+    WavReader(const WavReader&) = delete;
+    WavReader& operator=(const WavReader&) = delete;
+
+    /**
+     * @brief Reads up to `frames` mono samples into `out`
+     * @return Number of samples read, less than `frames` only at the end of the stream
+     */
+    size_t read(float* out, size_t frames);
+
+    /**
+     * @brief Time spent decoding PCM and resampling so far, in milliseconds
+     */
+    double decodeMs() const;
+    double resampleMs() const;
+
+    /**
+     * @brief Sample rate of the source before resampling
+     */
+    uint32_t sourceSampleRate() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+/**
+ * @brief Resamples interleaved float samples in one libsamplerate call
+ */
+std::vector<float> resampleWav(const std::vector<float>& inputSamples,
+                               uint32_t inputRate,
+                               uint32_t outputRate,
+                               uint32_t channels,
+                               ResampleQuality quality = ResampleQuality::Best);
+
 void fixSampleRate(const std::string& inputFile, const std::string& outputFile);
-ov::genai::RawSpeechInput read_wav(const std::string& filename);
+ov::genai::RawSpeechInput read_wav(const std::string& filename, ResampleQuality quality = ResampleQuality::Fastest);
 }  // namespace audio
 }  // namespace utils
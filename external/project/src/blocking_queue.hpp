@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/**
+ * @brief Unbounded multi-producer, multi-consumer FIFO used to hand work
+ * between pipeline threads.
+ *
+ * Once close() is called no more items can be pushed, and pop() returns
+ * std::nullopt after the remaining items have been drained.
+ */
+template <typename T>
+class BlockingQueue {
+ public:
+  void push(T item) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      items.push_back(std::move(item));
+    }
+    available.notify_one();
+  }
+
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this] { return !items.empty() || closed; });
+    if (items.empty()) {
+      return std::nullopt;
+    }
+    T item = std::move(items.front());
+    items.pop_front();
+    return item;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    available.notify_all();
+  }
+
+ private:
+  std::mutex mutex;
+  std::condition_variable available;
+  std::deque<T> items;
+  bool closed = false;
+};
@@ -1,148 +1,279 @@
 // Copyright (C) 2023-2024 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <future>
 #include <limits>
 #include <string>
-#include <iostream>
+#include <vector>
 
 #include "imwrite.hpp"
 
 #include "openvino/core/except.hpp"
 
+// the SSSE3 swizzle is compiled for every x86 build and picked at runtime, so it does not
+// depend on -mssse3 or /arch flags (MSVC never defines __SSSE3__)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define IMWRITE_SSSE3
+#include <tmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define IMWRITE_TARGET_SSSE3
+#else
+#define IMWRITE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
 namespace {
 
-unsigned char file[14] = {
-    'B',
-    'M',  // magic
-    0,
-    0,
-    0,
-    0,  // size in bytes
-    0,
-    0,  // app data
-    0,
-    0,  // app data
-    40 + 14,
-    0,
-    0,
-    0  // start of data offset
-};
-
-unsigned char info[40] = {
-    40,
-    0,
-    0,
-    0,  // info hd size
-    0,
-    0,
-    0,
-    0,  // width
-    0,
-    0,
-    0,
-    0,  // height
-    1,
-    0,  // number color planes
-    24,
-    0,  // bits per pixel
-    0,
-    0,
-    0,
-    0,  // compression is none
-    0,
-    0,
-    0,
-    0,  // image bits size
-    0x13,
-    0x0B,
-    0,
-    0,  // horz resolution in pixel / m
-    0x13,
-    0x0B,
-    0,
-    0,  // vert resolution (0x03C3 = 96 dpi, 0x0B13 = 72
-        // dpi)
-    0,
-    0,
-    0,
-    0,  // #colors in palette
-    0,
-    0,
-    0,
-    0,  // #important colors
-};
-
-void imwrite_single_image(const std::string& name, ov::Tensor image, bool convert_bgr2rgb) {
-    const ov::Shape shape = image.get_shape();
-    const size_t width = shape[2], height = shape[1], channels = shape[3];
-    OPENVINO_ASSERT(image.get_element_type() == ov::element::u8 &&
-        shape.size() == 4 && shape[0] == 1 && channels == 3,
-        "Image of u8 type and [1, H, W, 3] shape is expected.",
-        "Given image has shape ", shape, " and element type ", image.get_element_type());
+void put_u16_le(std::uint8_t* dst, std::uint32_t value) {
+    dst[0] = (std::uint8_t)(value);
+    dst[1] = (std::uint8_t)(value >> 8);
+}
 
-    std::ofstream output_file(name, std::ofstream::binary);
-    OPENVINO_ASSERT(output_file.is_open(), "Failed to open the output BMP image path");
+void put_u32_le(std::uint8_t* dst, std::uint32_t value) {
+    put_u16_le(dst, value);
+    put_u16_le(dst + 2, value >> 16);
+}
+
+void put_u32_be(std::uint8_t* dst, std::uint32_t value) {
+    dst[0] = (std::uint8_t)(value >> 24);
+    dst[1] = (std::uint8_t)(value >> 16);
+    dst[2] = (std::uint8_t)(value >> 8);
+    dst[3] = (std::uint8_t)(value);
+}
+
+#ifdef IMWRITE_SSSE3
+bool has_ssse3() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] >> 9) & 1;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+/**
+ * @brief Swaps the first and third channel of all but the last few pixels of a row
+ * @return Number of pixels written, the caller finishes the row
+ */
+IMWRITE_TARGET_SSSE3 size_t swap_row_ssse3(const std::uint8_t* src, std::uint8_t* dst, size_t width) {
+    // 5 pixels (15 bytes) per shuffle; the 16th byte is rewritten by the next iteration
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    size_t x = 0;
+    for (; x + 6 <= width; x += 5) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), _mm_shuffle_epi8(pixels, mask));
+    }
+    return x;
+}
+#endif
 
-    int padSize = static_cast<int>(4 - (width * channels) % 4) % 4;
-    int sizeData = static_cast<int>(width * height * channels + height * padSize);
-    int sizeAll = sizeData + sizeof(file) + sizeof(info);
+/**
+ * @brief Copies one row of 3 channel pixels, optionally swapping the first and third channel
+ */
+void copy_row(const std::uint8_t* src, std::uint8_t* dst, size_t width, bool swap_channels) {
+    if (!swap_channels) {
+        std::memcpy(dst, src, width * 3);
+        return;
+    }
 
-    file[2] = (unsigned char)(sizeAll);
-    file[3] = (unsigned char)(sizeAll >> 8);
-    file[4] = (unsigned char)(sizeAll >> 16);
-    file[5] = (unsigned char)(sizeAll >> 24);
+    size_t x = 0;
+#ifdef IMWRITE_SSSE3
+    static const bool use_ssse3 = has_ssse3();
+    if (use_ssse3) {
+        x = swap_row_ssse3(src, dst, width);
+    }
+#endif
+    for (; x < width; ++x) {
+        dst[x * 3] = src[x * 3 + 2];
+        dst[x * 3 + 1] = src[x * 3 + 1];
+        dst[x * 3 + 2] = src[x * 3];
+    }
+}
 
-    info[4] = (unsigned char)(width);
-    info[5] = (unsigned char)(width >> 8);
-    info[6] = (unsigned char)(width >> 16);
-    info[7] = (unsigned char)(width >> 24);
+std::vector<std::uint8_t> encode_bmp(const std::uint8_t* data, size_t width, size_t height, bool swap_channels) {
+    constexpr size_t file_header_size = 14, info_header_size = 40, header_size = file_header_size + info_header_size;
+    const size_t row_size = width * 3, pad_size = (4 - row_size % 4) % 4;
+    const size_t size_data = (row_size + pad_size) * height;
+    OPENVINO_ASSERT(header_size + size_data <= std::numeric_limits<std::int32_t>::max(), "Image is too large for BMP");
 
-    std::int32_t negativeHeight = -(int32_t)height;
-    info[8] = (unsigned char)(negativeHeight);
-    info[9] = (unsigned char)(negativeHeight >> 8);
-    info[10] = (unsigned char)(negativeHeight >> 16);
-    info[11] = (unsigned char)(negativeHeight >> 24);
+    std::vector<std::uint8_t> buffer(header_size + size_data, 0);
 
-    info[20] = (unsigned char)(sizeData);
-    info[21] = (unsigned char)(sizeData >> 8);
-    info[22] = (unsigned char)(sizeData >> 16);
-    info[23] = (unsigned char)(sizeData >> 24);
+    std::uint8_t* file = buffer.data();
+    file[0] = 'B';
+    file[1] = 'M';                                              // magic
+    put_u32_le(file + 2, std::uint32_t(buffer.size()));         // size in bytes
+    put_u32_le(file + 10, std::uint32_t(header_size));          // start of data offset
 
-    output_file.write(reinterpret_cast<char*>(file), sizeof(file));
-    output_file.write(reinterpret_cast<char*>(info), sizeof(info));
+    std::uint8_t* info = file + file_header_size;
+    put_u32_le(info, std::uint32_t(info_header_size));          // info hd size
+    put_u32_le(info + 4, std::uint32_t(width));                 // width
+    put_u32_le(info + 8, std::uint32_t(-std::int32_t(height))); // negative height, rows are top-down
+    put_u16_le(info + 12, 1);                                   // number color planes
+    put_u16_le(info + 14, 24);                                  // bits per pixel
+    put_u32_le(info + 20, std::uint32_t(size_data));            // image bits size
+    put_u32_le(info + 24, 0x0B13);                              // horz resolution in pixel / m (72 dpi)
+    put_u32_le(info + 28, 0x0B13);                              // vert resolution in pixel / m (72 dpi)
 
-    const std::uint8_t pad[3] = {0, 0, 0};
-    const std::uint8_t* data = image.data<const std::uint8_t>();
+    std::uint8_t* dst = buffer.data() + header_size;
+    for (size_t y = 0; y < height; ++y, dst += row_size + pad_size) {
+        copy_row(data + y * row_size, dst, width, swap_channels);
+    }
+    return buffer;
+}
 
-    for (size_t y = 0; y < height; y++) {
-        const std::uint8_t* current_row = data + y * width * channels;
-        if (convert_bgr2rgb) {
-            for (size_t x = 0; x < width; ++x) {
-                output_file.write(reinterpret_cast<const char*>(current_row + 2), 1);
-                output_file.write(reinterpret_cast<const char*>(current_row + 1), 1);
-                output_file.write(reinterpret_cast<const char*>(current_row), 1);
-                current_row += channels;
+std::uint32_t crc32(const std::uint8_t* data, size_t size) {
+    static const std::array<std::uint32_t, 256> table = [] {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t n = 0; n < 256; ++n) {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
             }
-        } else {
-            output_file.write(reinterpret_cast<const char*>(current_row), width * channels);
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+std::uint32_t adler32(const std::uint8_t* data, size_t size) {
+    constexpr std::uint32_t mod = 65521;
+    std::uint32_t a = 1, b = 0;
+    while (size > 0) {
+        // 5552 is the largest block for which the sums cannot overflow
+        size_t block = size < 5552 ? size : 5552;
+        size -= block;
+        while (block--) {
+            a += *data++;
+            b += a;
         }
-        output_file.write(reinterpret_cast<const char*>(pad), padSize);
+        a %= mod;
+        b %= mod;
+    }
+    return (b << 16) | a;
+}
+
+/**
+ * @brief Appends a PNG chunk (length, type, data, CRC) to `buffer`
+ */
+void append_png_chunk(std::vector<std::uint8_t>& buffer, const char* type, const std::vector<std::uint8_t>& data) {
+    const size_t start = buffer.size();
+    buffer.resize(start + 12 + data.size());
+    std::uint8_t* chunk = buffer.data() + start;
+    put_u32_be(chunk, std::uint32_t(data.size()));
+    std::memcpy(chunk + 4, type, 4);
+    if (!data.empty()) {
+        std::memcpy(chunk + 8, data.data(), data.size());
     }
+    put_u32_be(chunk + 8 + data.size(), crc32(chunk + 4, 4 + data.size()));
+}
+
+std::vector<std::uint8_t> encode_png(const std::uint8_t* data, size_t width, size_t height, bool swap_channels) {
+    const size_t row_size = width * 3, filtered_row_size = row_size + 1;
+    const size_t raw_size = filtered_row_size * height;
+    OPENVINO_ASSERT(width <= std::numeric_limits<std::int32_t>::max() && height <= std::numeric_limits<std::int32_t>::max(),
+        "Image is too large for PNG");
+
+    // rows prefixed with filter type 0 (none)
+    std::vector<std::uint8_t> raw(raw_size);
+    for (size_t y = 0; y < height; ++y) {
+        std::uint8_t* dst = raw.data() + y * filtered_row_size;
+        dst[0] = 0;
+        copy_row(data + y * row_size, dst + 1, width, swap_channels);
+    }
+
+    // zlib stream made of stored deflate blocks of at most 65535 bytes
+    constexpr size_t max_block = 65535;
+    const size_t num_blocks = raw_size == 0 ? 1 : (raw_size + max_block - 1) / max_block;
+    std::vector<std::uint8_t> idat(2 + num_blocks * 5 + raw_size + 4);
+    std::uint8_t* out = idat.data();
+    *out++ = 0x78;  // CM = deflate, 32K window
+    *out++ = 0x01;  // no preset dictionary, fastest compression level
+    for (size_t offset = 0, block = 0; block < num_blocks; ++block) {
+        const size_t len = std::min(max_block, raw_size - offset);
+        *out++ = block + 1 == num_blocks ? 1 : 0;  // BFINAL, BTYPE = stored
+        put_u16_le(out, std::uint32_t(len));
+        put_u16_le(out + 2, std::uint32_t(~len & 0xFFFF));
+        out += 4;
+        std::memcpy(out, raw.data() + offset, len);
+        out += len;
+        offset += len;
+    }
+    put_u32_be(out, adler32(raw.data(), raw.size()));
+
+    std::vector<std::uint8_t> ihdr(13, 0);
+    put_u32_be(ihdr.data(), std::uint32_t(width));
+    put_u32_be(ihdr.data() + 4, std::uint32_t(height));
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 2;  // color type RGB
+
+    static const std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<std::uint8_t> buffer(signature, signature + sizeof(signature));
+    buffer.reserve(sizeof(signature) + 3 * 12 + ihdr.size() + idat.size());
+    append_png_chunk(buffer, "IHDR", ihdr);
+    append_png_chunk(buffer, "IDAT", idat);
+    append_png_chunk(buffer, "IEND", {});
+    return buffer;
+}
+
+void imwrite_single_image(const std::string& name, ov::Tensor image, bool convert_bgr2rgb, ImageFormat format) {
+    const ov::Shape shape = image.get_shape();
+    OPENVINO_ASSERT(image.get_element_type() == ov::element::u8 &&
+        shape.size() == 4 && shape[0] == 1 && shape[3] == 3,
+        "Image of u8 type and [1, H, W, 3] shape is expected.",
+        "Given image has shape ", shape, " and element type ", image.get_element_type());
+    const size_t width = shape[2], height = shape[1];
+    const std::uint8_t* data = image.data<const std::uint8_t>();
+
+    // headers are built per call, so several images can be encoded at the same time
+    std::vector<std::uint8_t> encoded = format == ImageFormat::PNG
+        ? encode_png(data, width, height, !convert_bgr2rgb)
+        : encode_bmp(data, width, height, convert_bgr2rgb);
+
+    std::ofstream output_file(name, std::ofstream::binary);
+    OPENVINO_ASSERT(output_file.is_open(), "Failed to open the output image path ", name);
+    output_file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    OPENVINO_ASSERT(output_file.good(), "Failed to write the output image ", name);
+}
+
+std::string format_image_name(const std::string& pattern, int img_num) {
+    const int size = std::snprintf(nullptr, 0, pattern.c_str(), img_num);
+    OPENVINO_ASSERT(size >= 0, "Invalid image name pattern ", pattern);
+    std::vector<char> img_name(size_t(size) + 1);
+    std::snprintf(img_name.data(), img_name.size(), pattern.c_str(), img_num);
+    return std::string(img_name.data(), size_t(size));
 }
 
 } // namespace
 
 
-void imwrite(const std::string& name, ov::Tensor images, bool convert_bgr2rgb) {
+void imwrite(const std::string& name, ov::Tensor images, bool convert_bgr2rgb, ImageFormat format) {
     const ov::Shape shape = images.get_shape(), img_shape = {1, shape[1], shape[2], shape[3]};
     uint8_t* img_data = images.data<uint8_t>();
+    const size_t num_images = shape[0], img_size = ov::shape_size(img_shape);
 
-    for (int img_num = 0, num_images = shape[0], img_size = ov::shape_size(img_shape); img_num < num_images; ++img_num, img_data += img_size) {
-        char img_name[25];
-        sprintf(img_name, name.c_str(), img_num);
-
+    // each image is encoded and written on its own worker, get() rethrows any error
+    std::vector<std::future<void>> workers;
+    workers.reserve(num_images);
+    for (size_t img_num = 0; img_num < num_images; ++img_num, img_data += img_size) {
         ov::Tensor image(images.get_element_type(), img_shape, img_data);
-        imwrite_single_image(img_name, image, true);
+        workers.push_back(std::async(std::launch::async, imwrite_single_image,
+            format_image_name(name, int(img_num)), image, convert_bgr2rgb, format));
+    }
+    for (auto& worker : workers) {
+        worker.get();
     }
 }
@@ -8,9 +8,19 @@
 #include "openvino/runtime/tensor.hpp"
 
 /**
- * @brief Writes multiple images (depending on `image` tensor batch size) to BPM file(s)
+ * @brief Output format of `imwrite`
+ * BMP is 24 bit uncompressed, PNG is 8 bit RGB with stored (uncompressed) deflate blocks,
+ * so neither needs an image library to encode and both are cheap to decode.
+ */
+enum class ImageFormat { BMP, PNG };
+
+/**
+ * @brief Writes multiple images (depending on `image` tensor batch size) to BMP or PNG file(s)
+ * Images of a batch are encoded in parallel, each with a single write.
  * @param name File name or pattern to use to write images
  * @param image Image(s) tensor
- * @param convert_bgr2rgb Convert BGR to RGB
+ * @param convert_bgr2rgb Swap the channel order, i.e. `images` hold RGB pixels and BMP stores BGR.
+ * PNG stores RGB, so the channels are swapped there when this is false
+ * @param format Output file format
  */
-void imwrite(const std::string& name, ov::Tensor images, bool convert_bgr2rgb);
+void imwrite(const std::string& name, ov::Tensor images, bool convert_bgr2rgb, ImageFormat format = ImageFormat::BMP);
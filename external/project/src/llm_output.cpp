@@ -0,0 +1,361 @@
+#include "llm_output.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string_view>
+
+using json = nlohmann::json;
+
+// ----------------- Enums -----------------
+
+const std::unordered_map<LLMOutputType, std::string> outputTypeMap = {
+    {ID, "id"},
+    {TITLE, "title"},
+    {UPLOADER, "uploader"},
+    {AUDIOPATH, "audioPath"},
+    {JACKET, "jacket"},
+    {IMAGES, "images"},
+    {MOODS, "moods"},
+    {CREATEDAT, "createdAt"},
+    {UPDATEDAT, "updatedAt"},
+    {STATUS, "status"},
+    {COLOURS, "colours"},
+    {COLOURS_REASON, "colours_reason"},
+    {PARTICLES, "particles"},
+    {OBJECTS, "objects"},
+    {BACKGROUNDS, "backgrounds"},
+    {OBJECT_PROMPTS, "object_prompts"},
+    {BACKGROUND_PROMPTS, "background_prompts"},
+    {SHADER_BACKGROUND, "shaderBackground"},
+    {SHADER_TEXTURE, "shaderTexture"},
+    {PARTICLE_COLOUR, "particleColour"},
+    {YOUTUBEID, "youtubeId"}
+  };
+
+const std::unordered_map<std::string, LLMOutputType> outputTypeMapReverse = {
+    {"id", ID},
+    {"title", TITLE},
+    {"uploader", UPLOADER},
+    {"audioPath", AUDIOPATH},
+    {"jacket", JACKET},
+    {"images", IMAGES},
+    {"moods", MOODS},
+    {"createdAt", CREATEDAT},
+    {"updatedAt", UPDATEDAT},
+    {"status", STATUS},
+    {"colours", COLOURS},
+    {"colours_reason", COLOURS_REASON},
+    {"particles", PARTICLES},
+    {"objects", OBJECTS},
+    {"backgrounds", BACKGROUNDS},
+    {"object_prompts", OBJECT_PROMPTS},
+    {"background_prompts", BACKGROUND_PROMPTS},
+    {"shaderBackground", SHADER_BACKGROUND},
+    {"shaderTexture", SHADER_TEXTURE},
+    {"particleColour", PARTICLE_COLOUR},
+    {"youtubeId", YOUTUBEID}
+  };
+
+const std::unordered_map<LLMOutputType, bool> outputTypeIsVector = {
+    {ID, false},
+    {TITLE, false},
+    {UPLOADER, false},
+    {AUDIOPATH, false},
+    {JACKET, false},
+    {IMAGES, true},
+    {MOODS, true},
+    {CREATEDAT, false},
+    {UPDATEDAT, false},
+    {STATUS, false},
+    {COLOURS, true},
+    {COLOURS_REASON, true},
+    {PARTICLES, true},
+    {OBJECTS, true},
+    {BACKGROUNDS, true},
+    {OBJECT_PROMPTS, true},
+    {BACKGROUND_PROMPTS, true},
+    {SHADER_BACKGROUND, false},
+    {SHADER_TEXTURE, false},
+    {PARTICLE_COLOUR, true},
+    {YOUTUBEID, false}
+  };
+
+// ----------------- Parsing Functions -----------------
+
+namespace {
+
+// characters std::regex's '.' does not match
+bool isLineBreak(char c) {
+  return c == '\n' || c == '\r';
+}
+
+bool isHexDigit(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+         (c >= 'A' && c <= 'F');
+}
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+char toLower(char c) {
+  return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+bool isLetter(char c) {
+  c = toLower(c);
+  return c >= 'a' && c <= 'z';
+}
+
+// whitespace and the markdown the models wrap answers in
+bool isMarkup(char c) {
+  return isSpace(c) || c == '*' || c == ':';
+}
+
+// "Color N reason:" as asked for by the colour prompt, optionally indented or
+// in bold, so a preamble that only mentions the reasons is not counted
+bool isReasonLine(std::string_view line) {
+  line.remove_prefix(std::min(line.find_first_not_of(" \t*"), line.size()));
+  if (line.starts_with("colour")) {
+    line.remove_prefix(6);
+  } else if (line.starts_with("color")) {
+    line.remove_prefix(5);
+  } else {
+    return false;
+  }
+  line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+  size_t digits = std::min(line.find_first_not_of("0123456789"), line.size());
+  if (digits == 0) {
+    return false;
+  }
+  line.remove_prefix(digits);
+  line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+  return line.starts_with("reason");
+}
+
+}  // namespace
+
+std::vector<std::string> getOptionsFromLlmOutput(std::string llmOutput) {
+  std::vector<std::string> options;
+  // options are sandwiched by $ signs on a single line, a lone $ is ignored
+  size_t open = std::string::npos;
+  for (size_t i = 0; i < llmOutput.size(); i++) {
+    if (isLineBreak(llmOutput[i])) {
+      open = std::string::npos;
+    } else if (llmOutput[i] != '$') {
+      continue;
+    } else if (open == std::string::npos) {
+      open = i;
+    } else {
+      std::string unstrippedOption = llmOutput.substr(open, i - open + 1);
+      open = std::string::npos;
+      // strip the option of the leading and trailing characters (starts with ":
+      // $" and ends with "$") make sure length is at least 4 to avoid out of
+      // bounds error
+      if (unstrippedOption.size() < 4) {
+        throw std::runtime_error("Invalid option format");
+      }
+      std::string option =
+          unstrippedOption.substr(1, unstrippedOption.size() - 1);
+      options.push_back(option);
+    }
+  }
+  return options;
+}
+
+std::vector<std::string> getHexColoursFromLlmOutput(const std::string &llmOutput) {
+  std::vector<std::string> colours;
+  // a colour is a # followed by 6 hex digits, anything after them is ignored
+  size_t pos = llmOutput.find('#');
+  while (pos != std::string::npos) {
+    size_t digits = 0;
+    while (digits < 6 && pos + 1 + digits < llmOutput.size() &&
+           isHexDigit(llmOutput[pos + 1 + digits])) {
+      digits++;
+    }
+    if (digits == 6) {
+      colours.push_back(llmOutput.substr(pos, 7));
+    }
+    pos = llmOutput.find('#', pos + 1 + digits);
+  }
+  return colours;
+}
+
+// ----------------- Streaming Parsers -----------------
+
+size_t OutputItemCounter::feed(const std::string &text) {
+  for (char c : text) {
+    switch (item) {
+      case OutputItem::OPTION:
+        // same rules as getOptionsFromLlmOutput
+        if (isLineBreak(c)) {
+          run = -1;
+        } else if (c == '$') {
+          if (run < 0) {
+            run = 0;
+          } else {
+            items++;
+            run = -1;
+          }
+        }
+        break;
+      case OutputItem::HEX_COLOUR:
+        // same rules as getHexColoursFromLlmOutput
+        if (c == '#') {
+          run = 0;
+        } else if (run >= 0 && isHexDigit(c)) {
+          if (++run == 6) {
+            items++;
+            run = -1;
+          }
+        } else {
+          run = -1;
+        }
+        break;
+      case OutputItem::REASON_LINE:
+        // a reason only counts once its explanation is written, which may be
+        // on the line after "**Color N reason:**"
+        if (c == '\n') {
+          if (matched) {
+            items += explained;
+            awaitingExplanation = !explained;
+          } else if (awaitingExplanation && lineHasText) {
+            items++;
+            awaitingExplanation = false;
+          }
+          matched = explained = lineHasText = false;
+          current.clear();
+        } else {
+          if (matched) {
+            explained = explained || !isMarkup(c);
+          } else if (current.size() < 32) {
+            current += toLower(c);
+            matched = isReasonLine(current);
+          }
+          lineHasText = lineHasText || !isMarkup(c);
+        }
+        break;
+      case OutputItem::ZONE_COLOUR:
+        // only the first word of the output or of a line is the answer, a
+        // colour mentioned later in a sentence is not
+        if (isLetter(c)) {
+          if (current.empty()) {
+            firstWord = atLineStart;
+            atLineStart = false;
+          }
+          // longer words cannot be a colour name, keep one extra letter so
+          // they do not match
+          if (current.size() < 7) {
+            current += toLower(c);
+          }
+        } else {
+          if (!current.empty()) {
+            items += firstWord && (current == "red" || current == "blue" ||
+                                   current == "yellow" || current == "green");
+            current.clear();
+          }
+          if (c == '\n') {
+            atLineStart = true;
+          } else if (!isSpace(c) && c != '*') {
+            atLineStart = false;
+          }
+        }
+        break;
+      case OutputItem::WORD:
+        if (isSpace(c)) {
+          items += matched;
+          matched = false;
+        } else {
+          matched = true;
+        }
+        break;
+    }
+  }
+  return items;
+}
+
+StopCondition stopAfter(OutputItem item, size_t count) {
+  auto counter = std::make_shared<OutputItemCounter>(item);
+  return [counter, count](const std::string &text) {
+    return counter->feed(text) >= count;
+  };
+}
+
+StopCondition stopAfterAll(std::vector<StopCondition> conditions) {
+  return [conditions](const std::string &text) {
+    bool met = true;
+    for (const auto &condition : conditions) {
+      met = condition(text) && met;
+    }
+    return met;
+  };
+}
+
+// ----------------- Storage Functions -----------------
+
+LLMOutputMap readOutputFile(const std::string &filePath) {
+  LLMOutputMap outputMap;
+  json j;
+  // read existing json data from file if it exists
+  std::ifstream inputFile(filePath);
+  if (inputFile.is_open()) {
+    inputFile >> j;
+    inputFile.close();
+  } else {
+    j = json();
+  }
+  // store existing data in outputMap
+  for (const auto &output : j.items()) {
+    LLMOutputType outputType = outputTypeMapReverse.at(output.key());
+    if (outputTypeIsVector.at(outputType)) {
+      outputMap[outputType] = output.value();
+    } else {
+      outputMap[outputType] =
+          std::vector<std::string>{output.value().get<std::string>()};
+    }
+  }
+  return outputMap;
+}
+
+void writeOutputFile(const std::string &filePath, const LLMOutputMap &outputMap,
+                     bool debug) {
+  // create empty json object
+  json j;
+  if (debug) {
+    std::cout << "Output Map: " << std::endl;
+    for (const auto &output : outputMap) {
+      std::cout << outputTypeMap.at(output.first) << ": " << std::endl;
+      for (const auto &data : output.second) {
+        std::cout << data << std::endl;
+      }
+    }
+  }
+  // store whole colour string in json object
+  for (const auto &output : outputMap) {
+    std::string outputType = outputTypeMap.at(output.first);
+    const std::vector<std::string> &outputData = output.second;
+    // store data in json object based on whether it is a vector or not
+    if (outputTypeIsVector.at(output.first)) {
+      j[outputType] = outputData;
+    } else {
+      j[outputType] = outputData[0];
+    }
+  }
+
+  if (debug) {
+    std::cout << "JSON object: " << std::endl;
+    for (json::iterator it = j.begin(); it != j.end(); ++it) {
+      std::cout << it.key() << " : " << it.value() << "\n";
+    }
+  }
+
+  // write updated json object to file
+  std::ofstream outputFile(filePath);
+  outputFile << std::setw(4) << j << std::endl;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ----------------- Enums -----------------
+
+enum LLMOutputType {
+  // fields which are not generated by LLM
+  ID,
+  TITLE,
+  UPLOADER,
+  AUDIOPATH,
+  JACKET,
+  IMAGES,
+  MOODS,
+  CREATEDAT,
+  UPDATEDAT,
+  YOUTUBEID,
+
+  // fields which are generated by LLM
+  STATUS,
+  COLOURS,
+  COLOURS_REASON,
+  PARTICLES,
+  OBJECTS,
+  BACKGROUNDS,
+  OBJECT_PROMPTS,
+  BACKGROUND_PROMPTS,
+  SHADER_BACKGROUND,
+  SHADER_TEXTURE,
+  PARTICLE_COLOUR
+};
+
+extern const std::unordered_map<LLMOutputType, std::string> outputTypeMap;
+extern const std::unordered_map<std::string, LLMOutputType> outputTypeMapReverse;
+extern const std::unordered_map<LLMOutputType, bool> outputTypeIsVector;
+
+// values of every output field, single values are stored as a one element
+// vector
+using LLMOutputMap = std::unordered_map<LLMOutputType, std::vector<std::string>>;
+
+// ----------------- Parsing Functions -----------------
+
+/**
+ * @brief Extracts all options wrapped in $ signs from the LLM output.
+ *
+ * @param llmOutput Raw text generated by the LLM.
+ * @return std::vector<std::string> The options in the order they appear.
+ * @throws std::runtime_error If an option is too short to be stripped.
+ */
+std::vector<std::string> getOptionsFromLlmOutput(std::string llmOutput);
+
+/**
+ * @brief Extracts all #RRGGBB hex colours from the LLM output.
+ *
+ * @param llmOutput Raw text generated by the LLM.
+ * @return std::vector<std::string> The colours in the order they appear.
+ */
+std::vector<std::string> getHexColoursFromLlmOutput(const std::string &llmOutput);
+
+// ----------------- Streaming Parsers -----------------
+
+// items a stage waits for while its output is streamed
+enum class OutputItem {
+  OPTION,       // $option$, as found by getOptionsFromLlmOutput
+  HEX_COLOUR,   // #RRGGBB, as found by getHexColoursFromLlmOutput
+  REASON_LINE,  // "Color N reason:" line and its explanation
+  ZONE_COLOUR,  // zones of regulation colour name starting a line
+  WORD          // whitespace separated word
+};
+
+/**
+ * @brief Counts complete items in LLM output that arrives in pieces.
+ *
+ * Only a few bytes of state are kept between pieces, so every streamed piece
+ * is scanned once, however long the output gets.
+ */
+class OutputItemCounter {
+ public:
+  explicit OutputItemCounter(OutputItem item) : item(item) {}
+
+  /**
+   * @brief Scans the next piece of output.
+   *
+   * @return size_t Number of complete items seen so far.
+   */
+  size_t feed(const std::string &text);
+
+  size_t count() const { return items; }
+
+ private:
+  OutputItem item;
+  size_t items = 0;
+  // OPTION: inside $...$, HEX_COLOUR: digits after #, or -1
+  int run = -1;
+  // REASON_LINE / ZONE_COLOUR: lowercase start of the current line or word,
+  // bounded to what matching needs
+  std::string current;
+  // REASON_LINE: line is a reason, WORD: inside a word
+  bool matched = false;
+  // REASON_LINE: text after "reason:" or on the line, and a reason without
+  // explanation whose explanation is expected on the next non-empty line
+  bool explained = false;
+  bool lineHasText = false;
+  bool awaitingExplanation = false;
+  // ZONE_COLOUR: nothing but whitespace or * since the last line break, and
+  // whether the current word started there
+  bool atLineStart = true;
+  bool firstWord = false;
+};
+
+// fed every streamed piece of a stage, returns true once the stage has all the
+// items it needs and generation can stop
+using StopCondition = std::function<bool(const std::string &)>;
+
+/**
+ * @brief Stop condition which is met once `count` items have been streamed.
+ */
+StopCondition stopAfter(OutputItem item, size_t count);
+
+/**
+ * @brief Stop condition which is met once all `conditions` are met. Every
+ * condition sees every piece.
+ */
+StopCondition stopAfterAll(std::vector<StopCondition> conditions);
+
+// ----------------- Storage Functions -----------------
+
+/**
+ * @brief Reads the song data json file into an output map.
+ *
+ * @param filePath Path of the song data json file.
+ * @return LLMOutputMap The stored outputs, empty if the file does not exist.
+ */
+LLMOutputMap readOutputFile(const std::string &filePath);
+
+/**
+ * @brief Writes an output map to the song data json file, replacing it.
+ *
+ * @param filePath Path of the song data json file.
+ * @param outputMap Outputs to store.
+ * @param debug Print the output map and json object before writing.
+ */
+void writeOutputFile(const std::string &filePath, const LLMOutputMap &outputMap,
+                     bool debug);
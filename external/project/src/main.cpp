@@ -1,25 +1,37 @@
 #include <algorithm>
+#include <atomic>
 #include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <openvino/genai/image_generation/text2image_pipeline.hpp>
 #include <openvino/genai/llm_pipeline.hpp>
 #include <openvino/genai/whisper_pipeline.hpp>
 #include <openvino/openvino.hpp>
+#include <optional>
 #include <random>
 #include <ranges>
-#include <regex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 
 #include "audio_utils.hpp"
+#include "blocking_queue.hpp"
 #include "imwrite.hpp"
+#include "llm_output.hpp"
+#include "result_cache.hpp"
+#include "telemetry.hpp"
 
 std::ofstream logFile;
 
@@ -114,6 +126,7 @@ std::string logPath;
 std::filesystem::path lyricsDirPath;
 std::filesystem::path wavDirPath;
 std::filesystem::path imageDirPath;
+std::filesystem::path cacheDirPath;
 
 void setPaths() {
   gemmaModelPath =
@@ -132,8 +145,13 @@ void setPaths() {
   lyricsDirPath = (currentDirectory / "assets" / "lyrics");
   wavDirPath = (currentDirectory / "assets" / "audio");
   imageDirPath = (currentDirectory / "assets" / "images");
+  cacheDirPath = (currentDirectory / "assets" / "cache");
 }
 
+// ----------------- Result Cache -----------------
+// LLM results of previous runs, nullptr when caching is disabled
+std::shared_ptr<ResultCache> llmCache;
+
 
 
 
@@ -181,6 +199,39 @@ void finishJsonStorage() {
 
 
 // ----------------- Log Functions -----------------
+/*
+Forwards console output to the log file under a mutex. std::cout and std::cerr
+are only safe to share between threads while they write through stdio, the
+log file's std::filebuf is not, and batch mode writes from several threads.
+*/
+class SynchronizedStreambuf : public std::streambuf {
+ public:
+  explicit SynchronizedStreambuf(std::streambuf *target) : target(target) {}
+
+ protected:
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return target->sputc(traits_type::to_char_type(c));
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    return target->sputn(s, n);
+  }
+
+  int sync() override {
+    std::lock_guard<std::mutex> lock(mutex);
+    return target->pubsync();
+  }
+
+ private:
+  std::streambuf *target;
+  std::mutex mutex;
+};
+
 void redirectConsoleOutput() {
   logFile.open(logPath, std::ofstream::out | std::ofstream::trunc);
   logFile.close();
@@ -189,11 +240,22 @@ void redirectConsoleOutput() {
     std::cerr << "Error Unable to open log file!" << std::endl;
     exit(EXIT_FAILURE);
   }
-  std::cout.rdbuf(logFile.rdbuf());
-  std::cerr.rdbuf(logFile.rdbuf());
+  // never destroyed, std::cout may still be flushed during static destruction
+  static SynchronizedStreambuf *logBuffer =
+      new SynchronizedStreambuf(logFile.rdbuf());
+  std::cout.rdbuf(logBuffer);
+  std::cerr.rdbuf(logBuffer);
 }
 
 void cleanup() {
+  if (llmCache) {
+    std::cout << "LLM cache: " << llmCache->hits() << " hits, "
+              << llmCache->misses() << " misses" << std::endl;
+    telemetry::event("llm_cache", {{"hits", llmCache->hits()},
+                                   {"misses", llmCache->misses()}});
+  }
+  telemetry::event("exit", {{"peak_rss_bytes", telemetry::peakRssBytes()}});
+  telemetry::close();
   if (logFile.is_open()) {
     logFile.flush();
     logFile.close();
@@ -214,9 +276,11 @@ void cleanup() {
  * @throws std::runtime_error If no devices are available.
  */
 std::string getModelDevice() {
+  telemetry::Span span("device_discovery");
   ov::Core core;
 
   std::vector<std::string> availableDevices = core.get_available_devices();
+  span.set("available_devices", availableDevices);
   // print available devices
   // for (const auto &device : availableDevices)
   // {
@@ -232,18 +296,68 @@ std::string getModelDevice() {
 
   for (const auto &device : availableDevices) {
     if (device.find("NPU") != std::string::npos) {
+      span.set("device", device);
       return device;
     }
     // use GPU if available
     if (device.find("GPU") != std::string::npos) {
       std::cout << "Selected device: " << device << std::endl;
+      span.set("device", device);
       return device;
     }
   }
   std::cout << "Selected device: " << availableDevices[0] << std::endl;
+  span.set("device", availableDevices[0]);
   return availableDevices[0];
 }
 
+/**
+ * @brief Whether a pipeline for the device is compiled with prefix caching,
+ * which needs the continuous batching backend that NPU does not have.
+ */
+bool usesPrefixCaching(const std::string &device, bool prefixCaching) {
+  return prefixCaching && device.find("NPU") == std::string::npos;
+}
+
+/**
+ * @brief Creates the LLM pipeline used for all extraction stages.
+ *
+ * Every extraction prompt starts with the same lyrics setup, so with prefix
+ * caching enabled the KV cache of the lyrics is computed by the first stage
+ * and reused by the following ones, which then only prefill their task
+ * prompt. Prefix caching needs the continuous batching backend, which is not
+ * available on NPU, so it is skipped there.
+ *
+ * @param modelPath Path to the OpenVINO LLM model directory.
+ * @param device Device to compile the model for.
+ * @param prefixCaching Whether to enable prefix caching.
+ * @return std::shared_ptr<ov::genai::LLMPipeline> The compiled pipeline.
+ */
+std::shared_ptr<ov::genai::LLMPipeline> makeLLMPipeline(
+    const std::string &modelPath, const std::string &device,
+    bool prefixCaching) {
+  telemetry::Span span("llm_compile", {{"model", modelPath}, {"device", device}});
+  if (usesPrefixCaching(device, prefixCaching)) {
+    std::cout << "Prefix caching enabled" << std::endl;
+    span.set("prefix_caching", true);
+    ov::genai::SchedulerConfig schedulerConfig;
+    schedulerConfig.enable_prefix_caching = true;
+    return std::make_shared<ov::genai::LLMPipeline>(
+        modelPath, device, ov::genai::scheduler_config(schedulerConfig));
+  }
+  std::cout << "Prefix caching disabled" << std::endl;
+  span.set("prefix_caching", false);
+  return std::make_shared<ov::genai::LLMPipeline>(modelPath, device);
+}
+
+std::shared_ptr<ov::genai::WhisperPipeline> makeWhisperPipeline(
+    const std::string &device) {
+  telemetry::Span span("whisper_compile", {{"model", whisperModelPath.string()},
+                                           {"device", device}});
+  return std::make_shared<ov::genai::WhisperPipeline>(whisperModelPath.string(),
+                                                      device);
+}
+
 /**
  * @brief Retrieves the lyrics of a given song from a text file.
  *
@@ -256,6 +370,7 @@ std::string getModelDevice() {
  * @throws std::runtime_error If the lyrics file cannot be opened.
  */
 std::string getLyrics(std::string songName) {
+  telemetry::Span span("lyrics_load", {{"song", songName}});
   // read in lyrics from lyrics folder under song.txt
   std::string lyrics = "";
   std::string line;
@@ -272,6 +387,7 @@ std::string getLyrics(std::string songName) {
     throw std::runtime_error("Unable to open file");
   }
 
+  span.set("bytes", lyrics.size());
   return lyrics;
 }
 
@@ -292,184 +408,114 @@ auto getParticleEffectFromJson(std::string filePath) {
   }
 }
 
-std::vector<std::string> getOptionsFromLlmOutput(std::string llmOutput) {
-  // regex to match all options, sandwiched by
-  std::regex optionsRegex("\\$(.*?)\\$");
-  // create iterator to iterate through matches
-  std::sregex_iterator next(llmOutput.begin(), llmOutput.end(), optionsRegex);
-  std::sregex_iterator end;
-  std::vector<std::string> options;
-  // iterate through matches and store in vector
-  while (next != end) {
-    std::smatch match = *next;
-    std::string unstrippedOption = match.str();
-    // strip the option of the leading and trailing characters (starts with ":
-    // $" and ends with "$") make sure length is at least 4 to avoid out of
-    // bounds error
-    if (unstrippedOption.size() < 4) {
-      throw std::runtime_error("Invalid option format");
-    }
-    std::string option =
-        unstrippedOption.substr(1, unstrippedOption.size() - 1);
-    options.push_back(option);
-    next++;
-  }
-  return options;
-}
-
-// ----------------- Enums -----------------
-
-enum LLMOutputType {
-  // fields which are not generated by LLM
-  ID,
-  TITLE,
-  UPLOADER,
-  AUDIOPATH,
-  JACKET,
-  IMAGES,
-  MOODS,
-  CREATEDAT,
-  UPDATEDAT,
-  YOUTUBEID,
-
-  // fields which are generated by LLM
-  STATUS,
-  COLOURS,
-  COLOURS_REASON,
-  PARTICLES,
-  OBJECTS,
-  BACKGROUNDS,
-  OBJECT_PROMPTS,
-  BACKGROUND_PROMPTS,
-  SHADER_BACKGROUND,
-  SHADER_TEXTURE,
-  PARTICLE_COLOUR
-};
-
-const std::unordered_map<LLMOutputType, std::string> outputTypeMap = {
-    {ID, "id"},
-    {TITLE, "title"},
-    {UPLOADER, "uploader"},
-    {AUDIOPATH, "audioPath"},
-    {JACKET, "jacket"},
-    {IMAGES, "images"},
-    {MOODS, "moods"},
-    {CREATEDAT, "createdAt"},
-    {UPDATEDAT, "updatedAt"},
-    {STATUS, "status"},
-    {COLOURS, "colours"},
-    {COLOURS_REASON, "colours_reason"},
-    {PARTICLES, "particles"},
-    {OBJECTS, "objects"},
-    {BACKGROUNDS, "backgrounds"},
-    {OBJECT_PROMPTS, "object_prompts"},
-    {BACKGROUND_PROMPTS, "background_prompts"},
-    {SHADER_BACKGROUND, "shaderBackground"},
-    {SHADER_TEXTURE, "shaderTexture"},
-    {PARTICLE_COLOUR, "particleColour"},
-    {YOUTUBEID, "youtubeId"}
-  };
-
-const std::unordered_map<std::string, LLMOutputType> outputTypeMapReverse = {
-    {"id", ID},
-    {"title", TITLE},
-    {"uploader", UPLOADER},
-    {"audioPath", AUDIOPATH},
-    {"jacket", JACKET},
-    {"images", IMAGES},
-    {"moods", MOODS},
-    {"createdAt", CREATEDAT},
-    {"updatedAt", UPDATEDAT},
-    {"status", STATUS},
-    {"colours", COLOURS},
-    {"colours_reason", COLOURS_REASON},
-    {"particles", PARTICLES},
-    {"objects", OBJECTS},
-    {"backgrounds", BACKGROUNDS},
-    {"object_prompts", OBJECT_PROMPTS},
-    {"background_prompts", BACKGROUND_PROMPTS},
-    {"shaderBackground", SHADER_BACKGROUND},
-    {"shaderTexture", SHADER_TEXTURE},
-    {"particleColour", PARTICLE_COLOUR},
-    {"youtubeId", YOUTUBEID}
-  };
-
-const std::unordered_map<LLMOutputType, bool> outputTypeIsVector = {
-    {ID, false},
-    {TITLE, false},
-    {UPLOADER, false},
-    {AUDIOPATH, false},
-    {JACKET, false},
-    {IMAGES, true},
-    {MOODS, true},
-    {CREATEDAT, false},
-    {UPDATEDAT, false},
-    {STATUS, false},
-    {COLOURS, true},
-    {COLOURS_REASON, true},
-    {PARTICLES, true},
-    {OBJECTS, true},
-    {BACKGROUNDS, true},
-    {OBJECT_PROMPTS, true},
-    {BACKGROUND_PROMPTS, true},
-    {SHADER_BACKGROUND, false},
-    {SHADER_TEXTURE, false},
-    {PARTICLE_COLOUR, true},
-    {YOUTUBEID, false}
-  };
-
 // ----------------- LLM Class -----------------
 class LLM {
  private:
+  const std::string modelPath;
   const std::string device;
-  ov::genai::LLMPipeline pipe;
+  const bool prefixCaching;
+  // compiled on the first cache miss, see generate()
+  std::shared_ptr<ov::genai::LLMPipeline> pipe;
   const std::string songName;
   const std::string lyrics;
   const bool debug;
+  const bool earlyStop;
   std::string lyricsSetup;
   std::string shorterLyricsSetup;
   std::string outputFilePath;
 
-  std::unordered_map<LLMOutputType, std::vector<std::string>> outputMap;
-
-  std::string generate(std::string prompt, int max_new_tokens) {
-    return pipe.generate(prompt, ov::genai::max_new_tokens(max_new_tokens));
-  }
+  LLMOutputMap outputMap;
+
+  /**
+   * @brief Runs the LLM on a prompt, or returns the result of an earlier run
+   * from llmCache.
+   *
+   * The cache key covers everything that changes the result: model, device,
+   * backend, stage, prompt, lyrics and generation settings. Editing a prompt,
+   * the lyrics file or particleList.json therefore only misses for the stages
+   * that use it.
+   *
+   * @param stopCondition Fed the output while it is streamed, generation
+   * stops as soon as it returns true instead of running to `max_new_tokens`.
+   * Ignored when early stopping is disabled.
+   */
+  std::string generate(std::string prompt, int max_new_tokens,
+                       const std::string &stage,
+                       StopCondition stopCondition = nullptr) {
+    telemetry::Span span("llm_generate", {{"song", songName}, {"stage", stage}});
+    std::string cacheKey;
+    if (llmCache) {
+      cacheKey = ResultCache::makeKey(
+          {"llm-v1", modelPath, device, stage, prompt, lyrics,
+           std::to_string(max_new_tokens),
+           usesPrefixCaching(device, prefixCaching) ? "prefixCache"
+                                                    : "noPrefixCache",
+           earlyStop && stopCondition ? "earlyStop" : "full"});
+      if (std::optional<std::string> cached = llmCache->get(cacheKey)) {
+        std::cout << "Using cached " << stage << " output" << std::endl;
+        span.set("cache", "hit");
+        return *cached;
+      }
+      span.set("cache", "miss");
+    }
+    if (!pipe) {
+      pipe = makeLLMPipeline(modelPath, device, prefixCaching);
+    }
 
-  void retrieveCurrentOutput() {
-    json j;
-    // read existing json data from file if it exists
-    std::ifstream inputFile(outputFilePath);
-    if (inputFile.is_open()) {
-      std::cout << "Reading existing data from file" << std::endl;
-      inputFile >> j;
-      inputFile.close();
+    ov::genai::DecodedResults result;
+    bool stoppedEarly = false;
+    if (earlyStop && stopCondition) {
+      // bool streamers (true stops generation) work with every GenAI release
+      // from 2025.0 on, StreamingStatus streamers only from 2025.1
+      std::function<bool(std::string)> streamer = [&](std::string text) {
+        stoppedEarly = stopCondition(text);
+        return stoppedEarly;
+      };
+      result = pipe->generate(prompt, ov::genai::max_new_tokens(max_new_tokens),
+                              ov::genai::streamer(streamer));
     } else {
-      j = json();
+      result = pipe->generate(prompt, ov::genai::max_new_tokens(max_new_tokens));
     }
-    // store existing data in outputMap
-    for (const auto &output : j.items()) {
-      // std ::cout << "output type: " << output.key() << std::endl;
-      LLMOutputType outputType = outputTypeMapReverse.at(output.key());
-      if (outputTypeIsVector.at(outputType)) {
-        outputMap[outputType] = output.value();
-      } else {
-        // std::cout << "output value: " << output.value().get<std::string>()
-        //           << std::endl;
-        outputMap[outputType] =
-            std::vector<std::string>{output.value().get<std::string>()};
-      }
+
+    const auto &metrics = result.perf_metrics;
+    size_t generatedTokens = metrics.get_num_generated_tokens();
+    // unused part of the token budget, an upper bound on the decode tokens
+    // saved, as the model may have ended on its own soon after
+    size_t remainingTokenBudget = 0;
+    if (stoppedEarly && generatedTokens < size_t(max_new_tokens)) {
+      remainingTokenBudget = max_new_tokens - generatedTokens;
+      std::cout << "Stopped " << stage << " after " << generatedTokens
+                << " tokens, " << remainingTokenBudget
+                << " tokens of the budget left" << std::endl;
     }
+    if (telemetry::enabled()) {
+      span.set("prompt_tokens", metrics.get_num_input_tokens());
+      span.set("generated_tokens", generatedTokens);
+      span.set("ttft_ms", metrics.get_ttft().mean);
+      span.set("decode_tokens_per_s", metrics.get_throughput().mean);
+      span.set("stopped_early", stoppedEarly);
+      span.set("remaining_token_budget", remainingTokenBudget);
+    }
+    std::string output = result;
+    if (llmCache) {
+      llmCache->put(cacheKey, output);
+    }
+    return output;
   }
 
- public:
-  LLM(std::string llmModelPath, std::string songName, bool debug)
-      : device(getModelDevice()),
-        pipe(llmModelPath, device),
-        songName(songName),
-        lyrics(getLyrics(songName)),
-        debug(debug),
-        outputFilePath((songDataPath / (songName + ".json")).string()) {
+  // the reasons are stored with the colours, so the colour stage only stops
+  // once every colour has its reason line
+  static StopCondition colourStop() {
+    return stopAfterAll({stopAfter(OutputItem::HEX_COLOUR, 5),
+                         stopAfter(OutputItem::REASON_LINE, 5)});
+  }
+
+  void retrieveCurrentOutput() {
+    std::cout << "Reading existing data from file" << std::endl;
+    outputMap = readOutputFile(outputFilePath);
+  }
+
+  void init(const std::string &llmModelPath) {
     std::cout << "LLM Pipeline initialised with the following settings: "
               << std::endl;
     std::cout << "Model Path: " << llmModelPath << std::endl;
@@ -480,35 +526,61 @@ class LLM {
     lyricsSetup = lyricsPrompt + " " + songName + "\n" + lyrics;
     std::string truncatedLyrics = lyrics.substr(0, std::min(size_t(500), lyrics.length()));
     shorterLyricsSetup = lyricsPrompt + " " + songName + "\n" + truncatedLyrics;
-    outputMap = std::unordered_map<LLMOutputType, std::vector<std::string>>();
     retrieveCurrentOutput();
   }
 
+ public:
+  LLM(std::string llmModelPath, std::string songName, bool debug,
+      bool prefixCaching = true, std::string llmDevice = "",
+      bool earlyStop = true)
+      : modelPath(llmModelPath),
+        device(llmDevice.empty() ? getModelDevice() : llmDevice),
+        prefixCaching(prefixCaching),
+        songName(songName),
+        lyrics(getLyrics(songName)),
+        debug(debug),
+        earlyStop(earlyStop),
+        outputFilePath((songDataPath / (songName + ".json")).string()) {
+    init(llmModelPath);
+  }
+
+  // reuses an already compiled pipeline, so the model is only loaded once
+  // when several songs are processed by the same process (see serve mode)
+  LLM(std::shared_ptr<ov::genai::LLMPipeline> pipe, std::string llmModelPath,
+      std::string device, std::string songName, bool debug,
+      bool prefixCaching = true, bool earlyStop = true)
+      : modelPath(llmModelPath),
+        device(device),
+        prefixCaching(prefixCaching),
+        pipe(pipe),
+        songName(songName),
+        lyrics(getLyrics(songName)),
+        debug(debug),
+        earlyStop(earlyStop),
+        outputFilePath((songDataPath / (songName + ".json")).string()) {
+    init(llmModelPath);
+  }
+
+  // output file and a copy of the outputs, so they can be stored on another
+  // thread (see batch mode)
+  std::pair<std::string, LLMOutputMap> getOutput() const {
+    return {outputFilePath, outputMap};
+  }
+
   void extractColours() {
     std ::cout << "Extracting colours from lyrics" << std::endl;
     std::string colourPrompt = lyricsSetup + colourExtractionPrompt;
     std::string colourOutput;
     try{
-      colourOutput = generate(colourPrompt, 500);
+      colourOutput = generate(colourPrompt, 500, "extractColour", colourStop());
     } catch (const std::bad_alloc& e) {
       std::cerr << "Bad allocation error: " << e.what() << std::endl;
       std::cerr << "Trying with shorter lyrics" << std::endl;
-      colourOutput = generate(shorterLyricsSetup + colourExtractionPrompt, 500);
+      colourOutput = generate(shorterLyricsSetup + colourExtractionPrompt, 500,
+                              "extractColour", colourStop());
     }
 
-    std::vector<std::string> colours;
-    // regex to match hex colours
-    std::regex hexColour("#[0-9a-fA-F]{6}");
-    // create iterator to iterate through matches
-    std::sregex_iterator next(colourOutput.begin(), colourOutput.end(),
-                              hexColour);
-    std::sregex_iterator end;
-    // iterate through matches and store in json object
-    while (next != end) {
-      std::smatch match = *next;
-      colours.push_back(match.str());
-      next++;
-    }
+    std::vector<std::string> colours = getHexColoursFromLlmOutput(colourOutput);
 
     outputMap[COLOURS] = colours;
     outputMap[COLOURS_REASON] = {colourOutput};
@@ -524,11 +596,13 @@ class LLM {
     std::string zoneExtractionPrompt = lyricsSetup + statusPrompt + "\n";
     std::string statusOutput;
     try{
-      statusOutput = generate(zoneExtractionPrompt, 100);
+      statusOutput = generate(zoneExtractionPrompt, 100, "status",
+                              stopAfter(OutputItem::ZONE_COLOUR, 1));
     } catch (const std::bad_alloc& e) {
       std::cerr << "Bad allocation error: " << e.what() << std::endl;
       std::cerr << "Trying with shorter lyrics" << std::endl;
-      statusOutput = generate(shorterLyricsSetup + statusPrompt, 100);
+      statusOutput = generate(shorterLyricsSetup + statusPrompt, 100, "status",
+                              stopAfter(OutputItem::ZONE_COLOUR, 1));
     }
 
     // outputMap[STATUS] = getOptionsFromLlmOutput(statusOutput);
@@ -552,11 +626,13 @@ class LLM {
     }
     std::string particleOutput;
     try{
-      particleOutput = generate(particlePrompt, 100);
+      particleOutput = generate(particlePrompt, 100, "extractParticle",
+                                stopAfter(OutputItem::OPTION, 3));
     } catch (const std::bad_alloc& e) {
       std::cerr << "Bad allocation error: " << e.what() << std::endl;
       std::cerr << "Trying with shorter lyrics" << std::endl;
-      particleOutput = generate(shorterPrompt, 100);
+      particleOutput = generate(shorterPrompt, 100, "extractParticle",
+                                stopAfter(OutputItem::OPTION, 3));
     }
 
     outputMap[PARTICLES] = getOptionsFromLlmOutput(particleOutput);
@@ -571,11 +647,13 @@ class LLM {
     std::string objectPrompt = lyricsSetup + objectExtractionPrompt;
     std::string objectOutput;
     try{
-      objectOutput = generate(objectPrompt, 500);
+      objectOutput = generate(objectPrompt, 500, "extractObject",
+                              stopAfter(OutputItem::OPTION, 3));
     } catch (const std::bad_alloc& e) {
       std::cerr << "Bad allocation error: " << e.what() << std::endl;
       std::cerr << "Trying with shorter lyrics" << std::endl;
-      objectOutput = generate(shorterLyricsSetup + objectExtractionPrompt, 500);
+      objectOutput = generate(shorterLyricsSetup + objectExtractionPrompt, 500,
+                              "extractObject", stopAfter(OutputItem::OPTION, 3));
     }
     std::vector<std::string> objects = getOptionsFromLlmOutput(objectOutput);
 
@@ -596,11 +674,14 @@ class LLM {
     std::string backgroundPrompt = lyricsSetup + backgroundExtractionPrompt;
     std::string backgroundOutput;
     try {
-      backgroundOutput = generate(backgroundPrompt, 500);
+      backgroundOutput = generate(backgroundPrompt, 500, "extractBackground",
+                                  stopAfter(OutputItem::OPTION, 3));
     } catch (const std::bad_alloc& e) {
       std::cerr << "Bad allocation error: " << e.what() << std::endl;
       std::cerr << "Trying with shorter lyrics" << std::endl;
-      backgroundOutput = generate(shorterLyricsSetup + backgroundExtractionPrompt, 500);
+      backgroundOutput = generate(shorterLyricsSetup + backgroundExtractionPrompt,
+                                  500, "extractBackground",
+                                  stopAfter(OutputItem::OPTION, 3));
     }
     std::vector<std::string> backgrounds =
         getOptionsFromLlmOutput(backgroundOutput);
@@ -627,7 +708,9 @@ class LLM {
     std::vector<std::string> objects = outputMap[OBJECTS];
     for (const auto &object : objects) {
       std::string objectPromptPrompt = imageSetup + object + imageSettings + objectSettings;
-      std::string objectPrompt = generate(objectPromptPrompt, 500);
+      std::string objectPrompt = generate(objectPromptPrompt, 500,
+                                          "generateObjectPrompts",
+                                          stopAfter(OutputItem::WORD, 55));
       objectPromptList.push_back(objectPrompt);
     }
     outputMap[OBJECT_PROMPTS] = objectPromptList;
@@ -652,7 +735,9 @@ class LLM {
       std::string backgroundImagePromptPrompt =
           imageSetup + background + imageSettings + backgroundSettings;
       std::string backgroundImagePrompt =
-          generate(backgroundImagePromptPrompt, 500);
+          generate(backgroundImagePromptPrompt, 500,
+                   "generateBackgroundPrompts",
+                   stopAfter(OutputItem::WORD, 55));
       backgroundPromptList.push_back(backgroundImagePrompt);
     }
     outputMap[BACKGROUND_PROMPTS] = backgroundPromptList;
@@ -667,40 +752,7 @@ class LLM {
 
   void jsonStoreData() {
     std::cout << "Storing data in json file" << std::endl;
-    // create empty json object
-    json j;
-    if (debug) {
-      std::cout << "Output Map: " << std::endl;
-      for (const auto &output : outputMap) {
-        std::cout << outputTypeMap.at(output.first) << ": " << std::endl;
-        for (const auto &data : output.second) {
-          std::cout << data << std::endl;
-        }
-      }
-    }
-    // store whole colour string in json object
-    for (const auto &output : outputMap) {
-      std::string outputType = outputTypeMap.at(output.first);
-      std::vector<std::string> outputData = output.second;
-      // store data in json object based on whether it is a vector or not
-      if (outputTypeIsVector.at(output.first)) {
-        j[outputType] = outputData;
-      } else {
-        j[outputType] = outputData[0];
-      }
-    }
-
-    if (debug) {
-      std::cout << "JSON object: " << std::endl;
-      for (json::iterator it = j.begin(); it != j.end(); ++it) {
-        std::cout << it.key() << " : " << it.value() << "\n";
-      }
-    }
-
-
-    // write updated json object to file
-    std::ofstream outputFile(outputFilePath);
-    outputFile << std::setw(4) << j << std::endl;
+    writeOutputFile(outputFilePath, outputMap, debug);
   }
 };
 
@@ -708,23 +760,53 @@ class LLM {
 class Whisper {
  private:
   const std::string device;
-  ov::genai::WhisperPipeline pipe;
+  std::shared_ptr<ov::genai::WhisperPipeline> pipe;
   const std::string songId;
   const bool debug;
+  const utils::audio::ResampleQuality resampleQuality;
+
+  // audio is transcribed in windows of Whisper's native 30 s context, segments
+  // ending in the last few seconds of a window are left to the next window so
+  // words are not cut in half at the boundary
+  static constexpr double windowSeconds = 30.0;
+  static constexpr double overlapSeconds = 5.0;
+
+  /**
+   * @brief Transcribes one window and appends the finished segments to the
+   * lyrics file.
+   *
+   * @return double Seconds of the window that have been transcribed, the next
+   * window starts there.
+   */
+  double transcribeWindow(const ov::genai::RawSpeechInput &window,
+                          const ov::genai::WhisperGenerationConfig &config,
+                          bool lastWindow, std::ofstream &lyricsFile) {
+    telemetry::Span span("whisper_window", {{"song", songId},
+                                            {"samples", window.size()}});
+    ov::genai::WhisperDecodedResults result = pipe->generate(window, config);
+    if (!result.chunks) {
+      lyricsFile << std::string(result);
+      return windowSeconds;
+    }
 
-  void saveLyrics(std::string lyrics) {
-    std::string outputFilePath = (lyricsDirPath / (songId + ".txt")).string();
-    std::ofstream outputFile(outputFilePath);
-    outputFile << lyrics;
-    outputFile.close();
+    double transcribed = windowSeconds - overlapSeconds;
+    for (const auto &chunk : *result.chunks) {
+      bool cut = chunk.end_ts < 0 || chunk.end_ts > windowSeconds - overlapSeconds;
+      if (!lastWindow && cut && chunk.start_ts > 0) {
+        transcribed = chunk.start_ts;
+        break;
+      }
+      lyricsFile << chunk.text;
+      if (debug) {
+        std::cout << chunk.text << std::endl;
+      }
+      transcribed = chunk.end_ts < 0 ? windowSeconds : chunk.end_ts;
+    }
+    // always move forward, even if whisper returned a degenerate segment
+    return std::max(transcribed, 1.0);
   }
 
- public:
-  Whisper(std::string songId, bool debug)
-      : device(getModelDevice()),
-        pipe(whisperModelPath.string(), device),
-        songId(songId),
-        debug(debug) {
+  void init() {
     std::cout << "Whisper Pipeline initialised with the following settings: "
               << std::endl;
     std::cout << "Model Path: " << whisperModelPath << std::endl;
@@ -732,6 +814,32 @@ class Whisper {
     std::cout << "Song ID: " << songId << std::endl;
   }
 
+ public:
+  Whisper(std::string songId, bool debug,
+          utils::audio::ResampleQuality resampleQuality =
+              utils::audio::ResampleQuality::Fastest,
+          std::string whisperDevice = "")
+      : device(whisperDevice.empty() ? getModelDevice() : whisperDevice),
+        pipe(makeWhisperPipeline(device)),
+        songId(songId),
+        debug(debug),
+        resampleQuality(resampleQuality) {
+    init();
+  }
+
+  // reuses an already compiled pipeline (see serve mode)
+  Whisper(std::shared_ptr<ov::genai::WhisperPipeline> pipe, std::string device,
+          std::string songId, bool debug,
+          utils::audio::ResampleQuality resampleQuality =
+              utils::audio::ResampleQuality::Fastest)
+      : device(device),
+        pipe(pipe),
+        songId(songId),
+        debug(debug),
+        resampleQuality(resampleQuality) {
+    init();
+  }
+
   void generateLyrics() {
     std::cout << "Generating lyrics for song: " << songId << std::endl;
     std::string wavPath = (wavDirPath / (songId + ".wav")).string();
@@ -739,22 +847,55 @@ class Whisper {
 
     // set configs
     std::cout << "Setting generation config" << std::endl;
-    ov::genai::WhisperGenerationConfig config = pipe.get_generation_config();
+    ov::genai::WhisperGenerationConfig config = pipe->get_generation_config();
     config.max_new_tokens = 500;
     config.language = "<|en|>";
     config.task = "transcribe";
     config.return_timestamps = true;
 
-    // obtain raw speech input
-    std::cout << "Obtaining wav as raw input" << std::endl;
-    ov::genai::RawSpeechInput rawSpeech = utils::audio::read_wav(wavPath);
+    // stream the wav in windows, so memory use does not grow with the length
+    // of the song and lyrics are written while the rest is still decoding.
+    // Files that are not 16 kHz are resampled on the fly
+    std::cout << "Streaming wav as raw input" << std::endl;
+    utils::audio::WavReader reader(wavPath, resampleQuality);
+    std::string outputFilePath = (lyricsDirPath / (songId + ".txt")).string();
+    std::ofstream lyricsFile(outputFilePath);
+
+    const size_t windowSamples =
+        size_t(windowSeconds * utils::audio::COMMON_SAMPLE_RATE);
+    ov::genai::RawSpeechInput window;
+    window.reserve(windowSamples);
+    double windowStart = 0.0;
+    while (true) {
+      size_t buffered = window.size();
+      window.resize(windowSamples);
+      size_t read = reader.read(window.data() + buffered, windowSamples - buffered);
+      window.resize(buffered + read);
+      bool lastWindow = window.size() < windowSamples;
+      if (window.empty()) {
+        break;
+      }
 
-    std::string lyrics = pipe.generate(rawSpeech, config);
-    std::cout << "Lyrics generated: " << std::endl;
-    std::cout << lyrics << std::endl;
+      std::cout << "Transcribing from " << windowStart << " s" << std::endl;
+      double transcribed = transcribeWindow(window, config, lastWindow, lyricsFile);
+      lyricsFile.flush();
+      if (lastWindow) {
+        break;
+      }
 
-    saveLyrics(lyrics);
+      size_t consumed =
+          std::min(window.size(),
+                   size_t(transcribed * utils::audio::COMMON_SAMPLE_RATE));
+      window.erase(window.begin(), window.begin() + consumed);
+      windowStart += double(consumed) / utils::audio::COMMON_SAMPLE_RATE;
+    }
+    lyricsFile.close();
     std::cout << "Lyrics saved to file" << std::endl;
+    telemetry::event("audio_decode",
+                     {{"song", songId},
+                      {"source_sample_rate", reader.sourceSampleRate()},
+                      {"decode_ms", reader.decodeMs()},
+                      {"resample_ms", reader.resampleMs()}});
   }
 };
 
@@ -803,6 +944,406 @@ class StableDiffusion {
 };
 // STABLE DIFFUSION CLASS IS DEPRECATED
 
+// ----------------- Stage Runner -----------------
+// LLM stages in the order they are run, named after their command line flag
+const std::vector<std::string> llmStageFlags = {
+    "status",         "extractColour",         "extractParticle",
+    "extractObject",  "extractBackground",     "generateObjectPrompts",
+    "generateBackgroundPrompts"};
+
+void runLLMStage(LLM &llm, const std::string &stage) {
+  telemetry::Span span("llm_stage", {{"stage", stage}});
+  if (stage == "status") {
+    llm.extractStatus();
+    finishStatusExtraction();
+  } else if (stage == "extractColour") {
+    llm.extractColours();
+    finishColourExtraction();
+  } else if (stage == "extractParticle") {
+    llm.extractParticleEffect();
+    finishParticleExtraction();
+  } else if (stage == "extractObject") {
+    llm.extractObjects();
+    finishObjectExtraction();
+  } else if (stage == "extractBackground") {
+    llm.extractBackgrounds();
+    finishBackgroundExtraction();
+  } else if (stage == "generateObjectPrompts") {
+    llm.generateObjectPrompts();
+    finishObjectPrompts();
+  } else if (stage == "generateBackgroundPrompts") {
+    llm.generateBackgroundPrompts();
+    finishBackgroundPrompts();
+  } else {
+    throw std::runtime_error("Unknown LLM stage: " + stage);
+  }
+  span.set("peak_rss_bytes", telemetry::peakRssBytes());
+}
+
+void runWhisper(Whisper &whisper, const std::string &songId) {
+  telemetry::Span span("whisper_stage", {{"song", songId}});
+  whisper.generateLyrics();
+  span.set("peak_rss_bytes", telemetry::peakRssBytes());
+  span.end();
+  finishWhisper();
+  // delete wav file after lyrics have been generated
+  std::string wavPath = (wavDirPath / (songId + ".wav")).string();
+  std::filesystem::remove(wavPath);
+}
+
+// ----------------- Pipeline Settings -----------------
+// settings shared by every song processed in one run (serve and batch mode)
+struct PipelineSettings {
+  std::string llmModelPath;
+  // devices to compile each pipeline for, empty to use getModelDevice()
+  std::string whisperDevice;
+  std::string llmDevice;
+  bool debug;
+  bool prefixCaching;
+  bool earlyStop;
+  utils::audio::ResampleQuality resampleQuality;
+};
+
+// ----------------- Serve Mode -----------------
+/*
+Serve mode keeps the Whisper and LLM pipelines loaded between songs, so only
+the first job pays for device discovery and model compilation. Jobs are read
+as JSON lines from stdin, one per song, using the same stage names as the
+command line flags:
+  {"id": "1", "song": "let it go", "stages": ["whisper", "all"]}
+  {"command": "exit"}
+Every job streams one "progress" event per finished stage followed by one
+"result" (or "error") event, each as a single JSON line on stdout. All other
+console output is moved to stderr (or the text log) while serving.
+*/
+class Server {
+ private:
+  const PipelineSettings settings;
+  std::string device;
+  std::shared_ptr<ov::genai::WhisperPipeline> whisperPipe;
+  std::shared_ptr<ov::genai::LLMPipeline> llmPipe;
+
+  void emit(const json &event) {
+    std::string line = event.dump() + "\n";
+    fputs(line.c_str(), stdout);
+    fflush(stdout);
+  }
+
+  // pipelines are created on first use, so a Whisper only client never
+  // loads the LLM and vice versa
+  const std::string &getDevice() {
+    if (device.empty()) {
+      device = getModelDevice();
+    }
+    return device;
+  }
+
+  const std::string &getWhisperDevice() {
+    return settings.whisperDevice.empty() ? getDevice() : settings.whisperDevice;
+  }
+
+  const std::string &getLLMDevice() {
+    return settings.llmDevice.empty() ? getDevice() : settings.llmDevice;
+  }
+
+  std::shared_ptr<ov::genai::WhisperPipeline> getWhisperPipeline() {
+    if (!whisperPipe) {
+      whisperPipe = makeWhisperPipeline(getWhisperDevice());
+    }
+    return whisperPipe;
+  }
+
+  std::shared_ptr<ov::genai::LLMPipeline> getLLMPipeline() {
+    if (!llmPipe) {
+      llmPipe = makeLLMPipeline(settings.llmModelPath, getLLMDevice(),
+                                settings.prefixCaching);
+    }
+    return llmPipe;
+  }
+
+  void runJob(const json &job) {
+    json jobId = job.value("id", json());
+    if (!job.contains("song") || !job["song"].is_string()) {
+      throw std::runtime_error("Job is missing a song id");
+    }
+    std::string songId = job["song"].get<std::string>();
+
+    bool whisperStage = false;
+    std::vector<std::string> stages;
+    for (const auto &stage : job.value("stages", json::array())) {
+      std::string name = stage.get<std::string>();
+      if (name == "whisper") {
+        whisperStage = true;
+      } else if (name == "all") {
+        stages = llmStageFlags;
+      } else if (std::ranges::find(llmStageFlags, name) ==
+                 llmStageFlags.end()) {
+        throw std::runtime_error("Unknown stage: " + name);
+      } else if (std::ranges::find(stages, name) == stages.end()) {
+        stages.push_back(name);
+      }
+    }
+    // keep the command line execution order regardless of the request order
+    std::ranges::sort(stages, {}, [](const std::string &stage) {
+      return std::ranges::find(llmStageFlags, stage) - llmStageFlags.begin();
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    if (whisperStage) {
+      Whisper whisper(getWhisperPipeline(), getWhisperDevice(), songId,
+                      settings.debug, settings.resampleQuality);
+      runWhisper(whisper, songId);
+      emit({{"event", "progress"}, {"id", jobId}, {"song", songId},
+            {"stage", "whisper"}});
+    }
+    if (!stages.empty()) {
+      LLM llm(getLLMPipeline(), settings.llmModelPath, getLLMDevice(), songId,
+              settings.debug, settings.prefixCaching, settings.earlyStop);
+      for (const auto &stage : stages) {
+        runLLMStage(llm, stage);
+        emit({{"event", "progress"}, {"id", jobId}, {"song", songId},
+              {"stage", stage}});
+      }
+      llm.jsonStoreData();
+      finishJsonStorage();
+      finishLLM();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    emit({{"event", "result"}, {"id", jobId}, {"song", songId},
+          {"status", "ok"}, {"elapsed_ms", elapsed.count()}});
+  }
+
+ public:
+  Server(PipelineSettings settings) : settings(settings) {}
+
+  void run() {
+    emit({{"event", "ready"}});
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (line.empty()) {
+        continue;
+      }
+      json job;
+      try {
+        job = json::parse(line);
+        if (job.value("command", "") == "exit") {
+          break;
+        }
+        runJob(job);
+      } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        emit({{"event", "error"},
+              {"id", job.is_object() ? job.value("id", json()) : json()},
+              {"message", e.what()}});
+      }
+    }
+  }
+};
+
+// ----------------- Batch Mode -----------------
+/*
+Batch mode processes several songs in one process with a pipelined scheduler:
+  whisper thread: transcribes song N+1 ...
+  llm thread:     ... while the LLM stages of song N run, in stage order
+  io thread:      stores the song data json of song N-1
+Songs are handed between the threads through queues, so a song only reaches
+the LLM once its lyrics are written and its json is only stored once every
+stage has finished. A failed song is reported and skipped.
+*/
+class BatchRunner {
+ private:
+  struct SongOutput {
+    std::string songId;
+    std::string filePath;
+    LLMOutputMap outputMap;
+  };
+
+  const PipelineSettings settings;
+  const std::vector<std::string> songIds;
+  const bool whisperStage;
+  const std::vector<std::string> stages;
+
+  // songs with lyrics, waiting for the LLM stages
+  BlockingQueue<std::string> transcribed;
+  // finished songs, waiting to be stored
+  BlockingQueue<SongOutput> outputs;
+  std::atomic<int> songsDone = 0;
+  std::atomic<int> songsFailed = 0;
+
+  void finishSong(const std::string &songId) {
+    songsDone++;
+    std::cout << "Finished Song " << songId << std::endl;
+    telemetry::event("song_done", {{"song", songId}});
+  }
+
+  void failSong(const std::string &songId, const std::string &error) {
+    songsFailed++;
+    std::cerr << "Error: song " << songId << " failed: " << error << std::endl;
+    telemetry::event("song_failed", {{"song", songId}, {"error", error}});
+  }
+
+  void whisperWorker() {
+    size_t next = 0;
+    try {
+      std::string device = settings.whisperDevice.empty()
+                               ? getModelDevice()
+                               : settings.whisperDevice;
+      auto pipe = makeWhisperPipeline(device);
+      for (; next < songIds.size(); next++) {
+        const std::string &songId = songIds[next];
+        try {
+          Whisper whisper(pipe, device, songId, settings.debug,
+                          settings.resampleQuality);
+          runWhisper(whisper, songId);
+        } catch (const std::exception &e) {
+          failSong(songId, e.what());
+          continue;
+        }
+        if (stages.empty()) {
+          finishSong(songId);
+        } else {
+          transcribed.push(songId);
+        }
+      }
+    } catch (const std::exception &e) {
+      // the pipeline could not be created, none of the remaining songs can run
+      for (; next < songIds.size(); next++) {
+        failSong(songIds[next], e.what());
+      }
+    }
+    transcribed.close();
+  }
+
+  void llmWorker() {
+    try {
+      std::string device =
+          settings.llmDevice.empty() ? getModelDevice() : settings.llmDevice;
+      auto pipe = makeLLMPipeline(settings.llmModelPath, device,
+                                  settings.prefixCaching);
+      while (auto songId = transcribed.pop()) {
+        try {
+          LLM llm(pipe, settings.llmModelPath, device, *songId, settings.debug,
+                  settings.prefixCaching, settings.earlyStop);
+          for (const auto &stage : stages) {
+            runLLMStage(llm, stage);
+          }
+          auto [filePath, outputMap] = llm.getOutput();
+          outputs.push({*songId, filePath, std::move(outputMap)});
+        } catch (const std::exception &e) {
+          failSong(*songId, e.what());
+        }
+      }
+    } catch (const std::exception &e) {
+      while (auto songId = transcribed.pop()) {
+        failSong(*songId, e.what());
+      }
+    }
+    outputs.close();
+  }
+
+  void ioWorker() {
+    while (auto output = outputs.pop()) {
+      try {
+        writeOutputFile(output->filePath, output->outputMap, settings.debug);
+        finishJsonStorage();
+        finishSong(output->songId);
+      } catch (const std::exception &e) {
+        failSong(output->songId, e.what());
+      }
+    }
+  }
+
+ public:
+  BatchRunner(PipelineSettings settings, std::vector<std::string> songIds,
+              bool whisperStage, std::vector<std::string> stages)
+      : settings(settings),
+        songIds(songIds),
+        whisperStage(whisperStage),
+        stages(stages) {}
+
+  /**
+   * @brief Processes every song and reports the throughput.
+   *
+   * @return int The number of songs that failed.
+   */
+  int run() {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    if (whisperStage) {
+      workers.emplace_back(&BatchRunner::whisperWorker, this);
+    } else {
+      for (const auto &songId : songIds) {
+        transcribed.push(songId);
+      }
+      transcribed.close();
+    }
+    if (!stages.empty()) {
+      workers.emplace_back(&BatchRunner::llmWorker, this);
+      workers.emplace_back(&BatchRunner::ioWorker, this);
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    double songsPerHour = seconds > 0 ? songsDone * 3600.0 / seconds : 0.0;
+    std::cout << "Processed " << songsDone << " songs (" << songsFailed
+              << " failed) in " << seconds << " s, " << songsPerHour
+              << " songs per hour" << std::endl;
+    telemetry::event("batch", {{"songs", int(songsDone)},
+                               {"failed", int(songsFailed)},
+                               {"seconds", seconds},
+                               {"songs_per_hour", songsPerHour}});
+    return songsFailed;
+  }
+};
+
+/**
+ * @brief Resolves the --songs argument into song ids.
+ *
+ * @param songs A comma separated list of song ids, or a directory whose .wav
+ * and .txt files name the songs (e.g. assets/audio or assets/lyrics),
+ * ignoring the _fixed.wav copies written by --fixSampleRate. Audio and lyrics
+ * are still read from the usual asset directories.
+ * @return std::vector<std::string> The song ids, without duplicates.
+ */
+std::vector<std::string> getSongIds(const std::string &songs) {
+  std::vector<std::string> songIds;
+  if (std::filesystem::is_directory(songs)) {
+    for (const auto &entry : std::filesystem::directory_iterator(songs)) {
+      std::string extension = entry.path().extension().string();
+      std::string stem = entry.path().stem().string();
+      // <id>_fixed.wav is the 16kHz copy written by --fixSampleRate
+      bool fixedCopy = extension == ".wav" && stem.ends_with("_fixed");
+      if (entry.is_regular_file() && !fixedCopy &&
+          (extension == ".wav" || extension == ".txt")) {
+        songIds.push_back(stem);
+      }
+    }
+    std::ranges::sort(songIds);
+  } else {
+    std::stringstream songList(songs);
+    std::string songId;
+    while (std::getline(songList, songId, ',')) {
+      if (!songId.empty()) {
+        songIds.push_back(songId);
+      }
+    }
+  }
+  // keep the first occurrence of every song
+  std::vector<std::string> uniqueSongIds;
+  for (const auto &songId : songIds) {
+    if (std::ranges::find(uniqueSongIds, songId) == uniqueSongIds.end()) {
+      uniqueSongIds.push_back(songId);
+    }
+  }
+  return uniqueSongIds;
+}
+
 
 // ----------------- Main Function -----------------
 int main(int argc, char *argv[]) {
@@ -818,18 +1359,30 @@ int main(int argc, char *argv[]) {
   -l, --llm: use llm mode
   -S, --stable-diffusion: use stable diffusion mode
   -s, --song: specify song id
+  --songs <arg>: process several songs, comma separated ids or a directory
+  --whisperDevice <arg>: device for the Whisper pipeline, default picks one
+  --llmDevice <arg>: device for the LLM pipeline, default picks one
   --text_log: enable text logging
   -m, --model: specify model name
   -e, --electron: enable electron mode, exe is run from Super Happy Space
+  --serve: keep models loaded and process song jobs read from stdin
+  --telemetry <arg>: emit per-phase JSON events to stdout, stderr or fd:N
+  --trace <arg>: write a Chrome trace-event file
 
   Whisper only options
-    --fixSampleRate: fix sample rate of audio file to 16kHz
+    --fixSampleRate: write a 16kHz copy of the audio file, audio is otherwise
+                     resampled while it is transcribed
+    --resampleQuality <arg>: best, medium, fastest (default) or linear
 
   Stable diffusion only options
     --prompt <arg>: prompt to generate image
 
   LLM only options
     --smallerLLM: use smaller LLM model, with less parameters
+    --noPrefixCache: disable reuse of the lyrics KV cache between stages
+    --noEarlyStop: generate every stage up to its token limit
+    --noCache: always run the LLM instead of reusing results of earlier runs
+    --cacheSize <arg>: size limit of the LLM result cache in MB (default 64)
     --status: extract status from lyrics
     -c, --extractColour: extract colours from lyrics
     -p, --extractParticle: extract particle effect from lyrics
@@ -847,9 +1400,15 @@ int main(int argc, char *argv[]) {
       ("llm,l", "use llm mode")
       ("stable-diffusion,S","use stable diffusion mode")
       ("song,s", po::value<std::string>(), "specify song id")
+      ("songs", po::value<std::string>(), "process several songs: comma separated ids or a directory")
+      ("whisperDevice", po::value<std::string>(), "device for the Whisper pipeline")
+      ("llmDevice", po::value<std::string>(), "device for the LLM pipeline")
       ("text_log", "enable text logging")
       ("model,m", po::value<std::string>(), "specify model name")
-      ("electron,e", "enable electron mode");
+      ("electron,e", "enable electron mode")
+      ("serve", "keep models loaded and read song jobs as JSON lines from stdin")
+      ("telemetry", po::value<std::string>(), "emit per-phase JSON events to stdout, stderr or fd:N")
+      ("trace", po::value<std::string>(), "write a Chrome trace-event file");
 
   po::options_description stable_diffusion_options(
       "Stable Diffusion only options");
@@ -857,14 +1416,20 @@ int main(int argc, char *argv[]) {
                                          "prompt to generate image");
 
   po::options_description whisper_options("Whisper only options");
-  whisper_options.add_options()("fixSampleRate",
-                                "fix sample rate of audio file");
+  whisper_options.add_options()
+      ("fixSampleRate", "write a 16kHz copy of the audio file (no longer required)")
+      ("resampleQuality", po::value<std::string>()->default_value("fastest"),
+       "converter used for audio that is not 16kHz: best, medium, fastest or linear");
 
   po::options_description llm_options("LLM only options");
 
   llm_options.add_options()
       ("status", "extract status from lyrics")
       ("smallerLLM", "use smaller LLM model, with less parameters")
+      ("noPrefixCache", "recompute the lyrics for every stage instead of reusing their KV cache")
+      ("noEarlyStop", "generate every stage up to its token limit instead of stopping once its answer is complete")
+      ("noCache", "always run the LLM instead of reusing results of earlier runs")
+      ("cacheSize", po::value<size_t>()->default_value(64), "size limit of the LLM result cache in MB")
       ("extractColour,c", "extract colours from lyrics")(
       "extractParticle,p", "extract particle effect from lyrics")(
       "extractObject,o", "extract objects from lyrics")(
@@ -897,6 +1462,12 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
+  // serve mode reserves stdout for job events, so everything else goes to
+  // stderr from the first line on (or to the text log once it is opened)
+  if (vm.count("serve")) {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+
   if (vm.count("electron")) {
     std::cout << "Running in electron mode" << std::endl;
     // set current directory to electron directory
@@ -914,13 +1485,13 @@ int main(int argc, char *argv[]) {
   */
   // check if model type is specified
   if (!vm.count("whisper") && !vm.count("llm") &&
-      !vm.count("stable-diffusion")) {
+      !vm.count("stable-diffusion") && !vm.count("serve")) {
     std::cerr << "Error: Please specify a model type to use" << std::endl;
     return 1;
   }
 
   // if whisper, song has to be set
-  if (vm.count("whisper") && !vm.count("song")) {
+  if (vm.count("whisper") && !vm.count("song") && !vm.count("songs")) {
     std::cerr << "Error: Please specify a song id" << std::endl;
     return 1;
   }
@@ -937,6 +1508,18 @@ int main(int argc, char *argv[]) {
     redirectConsoleOutput();
   }
 
+  // telemetry is written with stdio, so it is not affected by the text log
+  if (vm.count("telemetry") || vm.count("trace")) {
+    try {
+      telemetry::open(vm.count("telemetry") ? vm["telemetry"].as<std::string>() : "",
+                      vm.count("trace") ? vm["trace"].as<std::string>() : "");
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      cleanup();
+      return 1;
+    }
+  }
+
   // check if song is specified
   if (vm.count("song")) {
     songId = vm["song"].as<std::string>();
@@ -959,13 +1542,69 @@ int main(int argc, char *argv[]) {
   }
 
   if (vm.count("all")) {
-    vm.insert({"status", po::variable_value()});
-    vm.insert({"extractColour", po::variable_value()});
-    vm.insert({"extractParticle", po::variable_value()});
-    vm.insert({"extractObject", po::variable_value()});
-    vm.insert({"extractBackground", po::variable_value()});
-    vm.insert({"generateObjectPrompts", po::variable_value()});
-    vm.insert({"generateBackgroundPrompts", po::variable_value()});
+    for (const auto &stage : llmStageFlags) {
+      vm.insert({stage, po::variable_value()});
+    }
+  }
+
+  if (vm.count("smallerLLM")) {
+    gemmaModelPath = smallerLLMPath;
+  }
+
+  utils::audio::ResampleQuality resampleQuality;
+  try {
+    resampleQuality = utils::audio::parseResampleQuality(
+        vm["resampleQuality"].as<std::string>());
+  } catch (const std::invalid_argument &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if (!vm.count("noCache")) {
+    try {
+      llmCache = std::make_shared<ResultCache>(
+          cacheDirPath, uintmax_t(vm["cacheSize"].as<size_t>()) << 20);
+    } catch (const std::filesystem::filesystem_error &e) {
+      std::cerr << "LLM cache disabled: " << e.what() << std::endl;
+    }
+  }
+
+  PipelineSettings settings{
+      gemmaModelPath,
+      vm.count("whisperDevice") ? vm["whisperDevice"].as<std::string>() : "",
+      vm.count("llmDevice") ? vm["llmDevice"].as<std::string>() : "",
+      debug,
+      !vm.count("noPrefixCache"),
+      !vm.count("noEarlyStop"),
+      resampleQuality};
+
+  // ================== Serve Mode ==================
+  if (vm.count("serve")) {
+    std::cerr << "Starting serve mode" << std::endl;
+    Server server(settings);
+    server.run();
+    cleanup();
+    return 0;
+  }
+
+  // ================== Batch Mode ==================
+  if (vm.count("songs")) {
+    std::vector<std::string> songIds =
+        getSongIds(vm["songs"].as<std::string>());
+    std::vector<std::string> stages;
+    if (vm.count("llm")) {
+      for (const auto &stage : llmStageFlags) {
+        if (vm.count(stage)) {
+          stages.push_back(stage);
+        }
+      }
+    }
+    std::cout << "Starting batch of " << songIds.size() << " songs"
+              << std::endl;
+    BatchRunner runner(settings, songIds, vm.count("whisper"), stages);
+    int failed = runner.run();
+    cleanup();
+    return failed ? 1 : 0;
   }
 
   // ================== Stable Diffusion Pipeline ==================
@@ -1011,13 +1650,10 @@ int main(int argc, char *argv[]) {
     else {
       std::cout << "Starting Whisper Pipeline" << std::endl;
       try {
-        Whisper whisper(songId, debug);
+        Whisper whisper(songId, debug, resampleQuality,
+                        settings.whisperDevice);
         finishAISetup();
-        whisper.generateLyrics();
-        finishWhisper();
-        // delete wav file after lyrics have been generated
-        std::string wavPath = (wavDirPath / (songId + ".wav")).string();
-        std::filesystem::remove(wavPath);
+        runWhisper(whisper, songId);
       } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
         cleanup();
@@ -1030,38 +1666,13 @@ int main(int argc, char *argv[]) {
   if (vm.count("llm")) {
     std::cout << "Starting LLM Pipeline" << std::endl;
     try {
-      if (vm.count("smallerLLM")){
-        gemmaModelPath = smallerLLMPath;
-      }
-      LLM llm(gemmaModelPath, songId, debug);
+      LLM llm(gemmaModelPath, songId, debug, settings.prefixCaching,
+              settings.llmDevice, settings.earlyStop);
       finishAISetup();
-      if (vm.count("status")) {
-        llm.extractStatus();
-        finishStatusExtraction();
-      }
-      if (vm.count("extractColour")) {
-        llm.extractColours();
-        finishColourExtraction();
-      }
-      if (vm.count("extractParticle")) {
-        llm.extractParticleEffect();
-        finishParticleExtraction();
-      }
-      if (vm.count("extractObject")) {
-        llm.extractObjects();
-        finishObjectExtraction();
-      }
-      if (vm.count("extractBackground")) {
-        llm.extractBackgrounds();
-        finishBackgroundExtraction();
-      }
-      if (vm.count("generateObjectPrompts")) {
-        llm.generateObjectPrompts();
-        finishObjectPrompts();
-      }
-      if (vm.count("generateBackgroundPrompts")) {
-        llm.generateBackgroundPrompts();
-        finishBackgroundPrompts();
+      for (const auto &stage : llmStageFlags) {
+        if (vm.count(stage)) {
+          runLLMStage(llm, stage);
+        }
       }
       llm.jsonStoreData();
       finishJsonStorage();
@@ -0,0 +1,246 @@
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <system_error>
+
+using json = nlohmann::json;
+
+namespace {
+
+// ----------------- SHA-256 -----------------
+class Sha256 {
+ public:
+  void update(const std::string &data) {
+    for (unsigned char c : data) {
+      block[blockSize++] = c;
+      if (blockSize == 64) {
+        compress();
+        blockSize = 0;
+      }
+    }
+    length += data.size();
+  }
+
+  std::string hexDigest() {
+    uint64_t bits = length * 8;
+    block[blockSize++] = 0x80;
+    if (blockSize > 56) {
+      std::fill(block.begin() + blockSize, block.end(), 0);
+      compress();
+      blockSize = 0;
+    }
+    std::fill(block.begin() + blockSize, block.begin() + 56, 0);
+    for (int i = 0; i < 8; i++) {
+      block[63 - i] = uint8_t(bits >> (8 * i));
+    }
+    compress();
+
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (uint32_t word : state) {
+      for (int shift = 28; shift >= 0; shift -= 4) {
+        hex += digits[(word >> shift) & 0xF];
+      }
+    }
+    return hex;
+  }
+
+ private:
+  std::array<uint32_t, 8> state = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                   0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                   0x1f83d9ab, 0x5be0cd19};
+  std::array<uint8_t, 64> block{};
+  size_t blockSize = 0;
+  uint64_t length = 0;
+
+  static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+  void compress() {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+      w[i] = uint32_t(block[i * 4]) << 24 | uint32_t(block[i * 4 + 1]) << 16 |
+             uint32_t(block[i * 4 + 2]) << 8 | uint32_t(block[i * 4 + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+      uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + k[i] + w[i];
+      uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+      uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+};
+
+// unique per writer, so concurrent puts of the same key never share a file
+std::string temporarySuffix() {
+  thread_local std::mt19937_64 generator(std::random_device{}());
+  std::ostringstream suffix;
+  suffix << std::hex << generator() << ".tmp";
+  return suffix.str();
+}
+
+}  // namespace
+
+// ----------------- Result Cache -----------------
+
+ResultCache::ResultCache(std::filesystem::path directory, uintmax_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {
+  std::filesystem::create_directories(this->directory);
+}
+
+std::string ResultCache::makeKey(const std::vector<std::string> &parts) {
+  Sha256 sha;
+  for (const auto &part : parts) {
+    sha.update(std::to_string(part.size()) + ":");
+    sha.update(part);
+  }
+  return sha.hexDigest();
+}
+
+std::filesystem::path ResultCache::entryPath(const std::string &key) const {
+  return directory / (key + ".json");
+}
+
+std::optional<std::string> ResultCache::get(const std::string &key) {
+  std::filesystem::path path = entryPath(key);
+  std::ifstream entryFile(path);
+  if (entryFile.is_open()) {
+    // a damaged entry is a miss, the next put replaces it
+    json entry = json::parse(entryFile, nullptr, false);
+    if (entry.is_object() && entry.value("key", "") == key &&
+        entry.contains("value") && entry["value"].is_string()) {
+      std::error_code error;
+      std::filesystem::last_write_time(
+          path, std::filesystem::file_time_type::clock::now(), error);
+      hitCount++;
+      return entry["value"].get<std::string>();
+    }
+  }
+  missCount++;
+  return std::nullopt;
+}
+
+void ResultCache::put(const std::string &key, const std::string &value) {
+  std::filesystem::path path = entryPath(key);
+  std::filesystem::path temporaryPath =
+      directory / (key + "." + temporarySuffix());
+  {
+    std::ofstream entryFile(temporaryPath, std::ios::binary);
+    entryFile << json{{"key", key}, {"value", value}}.dump();
+    if (!entryFile.good()) {
+      std::cerr << "Unable to write cache entry " << temporaryPath.string()
+                << std::endl;
+      entryFile.close();
+      std::error_code error;
+      std::filesystem::remove(temporaryPath, error);
+      return;
+    }
+  }
+  // readers only ever see a complete entry
+  std::error_code error;
+  std::filesystem::rename(temporaryPath, path, error);
+  if (error) {
+    std::cerr << "Unable to store cache entry " << path.string() << ": "
+              << error.message() << std::endl;
+    std::filesystem::remove(temporaryPath, error);
+    return;
+  }
+  try {
+    evict();
+  } catch (const std::filesystem::filesystem_error &e) {
+    std::cerr << "Unable to evict cache entries: " << e.what() << std::endl;
+  }
+}
+
+void ResultCache::evict() {
+  struct Entry {
+    std::filesystem::path path;
+    uintmax_t size;
+    std::filesystem::file_time_type lastUsed;
+  };
+  std::vector<Entry> entries;
+  uintmax_t totalBytes = 0;
+  const auto now = std::filesystem::file_time_type::clock::now();
+
+  std::error_code error;
+  for (const auto &file :
+       std::filesystem::directory_iterator(directory, error)) {
+    std::error_code fileError;
+    auto lastUsed = file.last_write_time(fileError);
+    if (fileError) {
+      continue;
+    }
+    if (file.path().extension() == ".tmp") {
+      // left behind by a writer that did not finish
+      if (now - lastUsed > std::chrono::hours(1)) {
+        std::filesystem::remove(file.path(), fileError);
+      }
+      continue;
+    }
+    if (file.path().extension() != ".json") {
+      continue;
+    }
+    uintmax_t size = file.file_size(fileError);
+    if (fileError) {
+      continue;
+    }
+    entries.push_back({file.path(), size, lastUsed});
+    totalBytes += size;
+  }
+  if (totalBytes <= maxBytes) {
+    return;
+  }
+
+  std::ranges::sort(entries, {}, &Entry::lastUsed);
+  for (const auto &entry : entries) {
+    if (totalBytes <= maxBytes) {
+      break;
+    }
+    // another process may have evicted it already, either way it is gone
+    std::filesystem::remove(entry.path, error);
+    totalBytes -= entry.size;
+  }
+}
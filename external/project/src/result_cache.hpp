@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+Persistent, content-addressed cache of LLM results. Every entry is one file
+named after the SHA-256 of everything that produced the value (model, device,
+prompt, lyrics, generation settings), so a changed input simply misses and the
+stale entry ages out. Entries are written to a temporary file and renamed into
+place, so several cppVer processes can share one cache directory. The cache is
+bounded in bytes and evicts the least recently used entries, using the file
+modification time as the last use.
+*/
+class ResultCache {
+ public:
+  /**
+   * @param directory Cache directory, created if it does not exist.
+   * @param maxBytes Total size of the entries kept after every insert.
+   */
+  ResultCache(std::filesystem::path directory, uintmax_t maxBytes);
+
+  /**
+   * @brief Builds a cache key from the inputs that produced a value.
+   *
+   * @param parts Inputs in a fixed order, parts are length prefixed so they
+   * cannot run into each other.
+   * @return std::string Hex SHA-256 of the parts.
+   */
+  static std::string makeKey(const std::vector<std::string> &parts);
+
+  /**
+   * @brief Looks up a value and marks it as recently used.
+   *
+   * @return std::optional<std::string> The value, std::nullopt on a miss.
+   */
+  std::optional<std::string> get(const std::string &key);
+
+  /**
+   * @brief Stores a value, then evicts entries until the cache fits again.
+   * Failing to write is reported but not thrown, the cache is only an
+   * optimisation.
+   */
+  void put(const std::string &key, const std::string &value);
+
+  size_t hits() const { return hitCount; }
+  size_t misses() const { return missCount; }
+
+ private:
+  const std::filesystem::path directory;
+  const uintmax_t maxBytes;
+  std::atomic<size_t> hitCount = 0;
+  std::atomic<size_t> missCount = 0;
+
+  std::filesystem::path entryPath(const std::string &key) const;
+  void evict();
+};
@@ -0,0 +1,184 @@
+#include "telemetry.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+std::mutex mutex;
+std::atomic<bool> isEnabled = false;
+FILE *eventsFile = nullptr;
+bool ownsEventsFile = false;
+// trace events are streamed as they happen, so a long running process (serve
+// mode) does not keep them in memory
+FILE *traceFile = nullptr;
+bool firstTraceEvent = true;
+const std::chrono::steady_clock::time_point epoch =
+    std::chrono::steady_clock::now();
+
+double msSinceEpoch(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration<double, std::milli>(time - epoch).count();
+}
+
+size_t threadId() {
+  return std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000;
+}
+
+// writes one event line and records it for the trace, `durationMs` < 0 marks
+// an instantaneous event
+void emit(const std::string &phase, json fields,
+          std::chrono::steady_clock::time_point start, double durationMs) {
+  fields["event"] = "telemetry";
+  fields["phase"] = phase;
+  fields["ts_ms"] = msSinceEpoch(start);
+  if (durationMs >= 0) {
+    fields["duration_ms"] = durationMs;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (eventsFile) {
+    std::string line = fields.dump() + "\n";
+    fputs(line.c_str(), eventsFile);
+    fflush(eventsFile);
+  }
+  if (traceFile) {
+    json traceEvent = {{"name", phase},
+                       {"cat", "cppVer"},
+                       {"ph", durationMs >= 0 ? "X" : "i"},
+                       {"ts", msSinceEpoch(start) * 1000.0},
+                       {"pid", 1},
+                       {"tid", threadId()},
+                       {"args", fields}};
+    if (durationMs >= 0) {
+      traceEvent["dur"] = durationMs * 1000.0;
+    } else {
+      traceEvent["s"] = "t";
+    }
+    std::string line = (firstTraceEvent ? "" : ",\n") + traceEvent.dump();
+    fputs(line.c_str(), traceFile);
+    firstTraceEvent = false;
+  }
+}
+
+}  // namespace
+
+namespace telemetry {
+
+void open(const std::string &eventsTarget, const std::string &tracePath) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (eventsTarget == "stdout") {
+    eventsFile = stdout;
+  } else if (eventsTarget == "stderr") {
+    eventsFile = stderr;
+  } else if (eventsTarget.rfind("fd:", 0) == 0) {
+    int fd = std::stoi(eventsTarget.substr(3));
+#ifdef _WIN32
+    eventsFile = _fdopen(fd, "w");
+#else
+    eventsFile = fdopen(fd, "w");
+#endif
+    if (!eventsFile) {
+      throw std::runtime_error("Unable to open telemetry " + eventsTarget);
+    }
+    ownsEventsFile = true;
+  } else if (!eventsTarget.empty()) {
+    throw std::runtime_error("Unknown telemetry target: " + eventsTarget);
+  }
+  if (!tracePath.empty()) {
+    traceFile = fopen(tracePath.c_str(), "w");
+    if (!traceFile) {
+      throw std::runtime_error("Unable to open trace file " + tracePath);
+    }
+    fputs("{\"traceEvents\": [\n", traceFile);
+    firstTraceEvent = true;
+  }
+  isEnabled = eventsFile || traceFile;
+}
+
+void close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (traceFile) {
+    fputs("\n], \"displayTimeUnit\": \"ms\"}\n", traceFile);
+    fclose(traceFile);
+    traceFile = nullptr;
+  }
+  if (ownsEventsFile) {
+    fclose(eventsFile);
+  }
+  eventsFile = nullptr;
+  ownsEventsFile = false;
+  isEnabled = false;
+}
+
+bool enabled() {
+  return isEnabled;
+}
+
+void event(const std::string &phase, json fields) {
+  if (!isEnabled) {
+    return;
+  }
+  emit(phase, std::move(fields), std::chrono::steady_clock::now(), -1.0);
+}
+
+size_t peakRssBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return counters.PeakWorkingSetSize;
+  }
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss);
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+Span::Span(std::string phase, json fields)
+    : phase(std::move(phase)),
+      fields(std::move(fields)),
+      start(std::chrono::steady_clock::now()) {}
+
+Span::~Span() {
+  end();
+}
+
+void Span::set(const std::string &key, json value) {
+  fields[key] = std::move(value);
+}
+
+void Span::end() {
+  if (ended) {
+    return;
+  }
+  ended = true;
+  if (!isEnabled) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  emit(phase, std::move(fields), start,
+       std::chrono::duration<double, std::milli>(now - start).count());
+}
+
+}  // namespace telemetry
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <nlohmann/json.hpp>
+#include <string>
+
+/*
+Per-phase performance telemetry. When enabled, every phase is reported as one
+JSON line, e.g.
+  {"event": "telemetry", "phase": "llm_generate", "ts_ms": 5120.4,
+   "duration_ms": 2310.7, "stage": "extractColour", "prompt_tokens": 812, ...}
+and can also be collected into a Chrome trace-event file (chrome://tracing,
+Perfetto). Telemetry is off by default and then costs a clock read per phase.
+*/
+namespace telemetry {
+
+/**
+ * @brief Enables telemetry.
+ *
+ * @param eventsTarget Where JSON events go: "stdout", "stderr" or "fd:N" for an
+ * already open file descriptor. Empty to only collect the trace.
+ * @param tracePath Chrome trace-event file, written as events happen and
+ * completed by close(), empty for none.
+ * @throws std::runtime_error If the target cannot be opened.
+ */
+void open(const std::string &eventsTarget, const std::string &tracePath);
+
+/**
+ * @brief Completes the trace file, if any, and stops emitting events.
+ */
+void close();
+
+bool enabled();
+
+/**
+ * @brief Emits an instantaneous event for `phase` with extra `fields`.
+ */
+void event(const std::string &phase, nlohmann::json fields = nlohmann::json::object());
+
+/**
+ * @brief Peak resident set size of the process in bytes, 0 if unknown.
+ */
+size_t peakRssBytes();
+
+/**
+ * @brief Times a phase from construction to destruction (or end()), emitting
+ * one event with its duration and any fields added in between.
+ */
+class Span {
+ public:
+  explicit Span(std::string phase,
+                nlohmann::json fields = nlohmann::json::object());
+  ~Span();
+
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  void set(const std::string &key, nlohmann::json value);
+  void end();
+
+ private:
+  std::string phase;
+  nlohmann::json fields;
+  std::chrono::steady_clock::time_point start;
+  bool ended = false;
+};
+
+}  // namespace telemetry